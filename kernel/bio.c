@@ -1,17 +1,29 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
-// cached copies of disk block contents.  Caching disk blocks
+// The buffer cache is a hash table of buf structures holding
+// cached copies of disk block contents, keyed by (dev, blockno),
+// with a lock per hash bucket so that lookups of different
+// blocks don't contend.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
 //
 // Interface:
 // * To get a buffer for a particular disk block, call bread.
+//     bnew skips the read, for a block about to be overwritten.
 // * After changing buffer data, call bwrite to write it to disk.
 // * When done with the buffer, call brelse.
 // * Do not use the buffer after calling brelse.
 // * Only one process at a time can use a buffer,
 //     so do not keep them longer than necessary.
+// * breadahead starts reading a block that will be needed
+//     soon, without waiting for it.
+// * bwrite_start starts writing a buffer; bwait waits for that
+//     write, so that many writes can be in flight at once.
+//     bwritev_start starts several at once.
+// * bshadow makes a buffer outside the cache holding a copy of
+//     some data for a block, to write without disturbing the
+//     cached copy; bshadowfree frees it.
+// * Disk requests go through the I/O scheduler (iosched.c).
 
 
 #include "types.h"
@@ -23,69 +35,167 @@
 #include "fs.h"
 #include "buf.h"
 
+#define NBUCKET 127     // hash buckets; prime
+#define NBUFMAX 4096    // upper bound on the number of buffers
+
+struct bucket {
+  struct spinlock lock;
+  struct buf *head;       // chain through buf.next
+};
+
 struct {
+  // serializes bget() misses, so that a miss may hold two
+  // bucket locks at once while it moves a buffer between them.
   struct spinlock lock;
-  struct buf buf[NBUF];
+  struct bucket bucket[NBUCKET];
+  struct buf *buf[NBUFMAX];
+  int nbuf;
+  int hand;               // clock hand for eviction, protected by lock
 
-  // Linked list of all buffers, through prev/next.
-  // Sorted by how recently the buffer was used.
-  // head.next is most recent, head.prev is least.
-  struct buf head;
+  // read-ahead counters, updated atomically.
+  int raissued;          // blocks prefetched
+  int rahit;             // prefetched blocks later read
+  int rawasted;          // prefetched blocks evicted unread
+  int radropped;         // prefetches skipped, cache or queue full
+  int rapending;         // prefetches not yet read
 } bcache;
 
+static struct kmem_cache *bufcache;
+
+static inline struct bucket*
+bhash(uint dev, uint blockno)
+{
+  return &bcache.bucket[(dev * 31 + blockno) % NBUCKET];
+}
+
+// Size the cache from the free memory at boot:
+// one buffer per 32 free pages, but no fewer than NBUF.
+// Buffer sleep locks stay out of the lock stats table
+// (see initlock_unlisted()), so only NBUFMAX bounds the cache.
 void
 binit(void)
 {
   struct buf *b;
+  int n;
 
   initlock(&bcache.lock, "bcache");
+  for(int i = 0; i < NBUCKET; i++)
+    initlock(&bcache.bucket[i].lock, "bcache.bucket");
+  bufcache = kmem_cache_create("buf", sizeof(struct buf));
 
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
-  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
+  n = kgetfree() / PGSIZE / 32;
+  if(n < NBUF)
+    n = NBUF;
+  if(n > NBUFMAX)
+    n = NBUFMAX;
+  for(bcache.nbuf = 0; bcache.nbuf < n; bcache.nbuf++){
+    if((b = kmem_cache_alloc(bufcache)) == 0)
+      break;
+    memset(b, 0, sizeof(*b));
+    b->blockno = bcache.nbuf;  // spread the empty buffers out
     initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    struct bucket *bk = bhash(b->dev, b->blockno);
+    b->next = bk->head;
+    bk->head = b;
+    bcache.buf[bcache.nbuf] = b;
+  }
+  if(bcache.nbuf < NBUF)
+    panic("binit");
+}
+
+// Find an unused buffer with the clock algorithm: skip
+// buffers that are in use, and give recently used ones a
+// second chance. Returns it unlinked from its bucket.
+// Caller must hold bcache.lock and the lock of bucket bk,
+// which is the bucket the buffer is for.
+static struct buf*
+bevict(struct bucket *bk)
+{
+  for(int i = 0; i < 2 * bcache.nbuf; i++){
+    struct buf *b = bcache.buf[bcache.hand];
+    bcache.hand = (bcache.hand + 1) % bcache.nbuf;
+
+    struct bucket *old = bhash(b->dev, b->blockno);
+    if(old != bk)
+      acquire(&old->lock);
+    if(b->refcnt == 0 && !b->used){
+      struct buf **pp;
+      if(b->readahead){
+        b->readahead = 0;
+        __sync_fetch_and_add(&bcache.rawasted, 1);
+      }
+      for(pp = &old->head; *pp != b; pp = &(*pp)->next)
+        ;
+      *pp = b->next;
+      if(old != bk)
+        release(&old->lock);
+      return b;
+    }
+    b->used = 0;
+    if(old != bk)
+      release(&old->lock);
   }
+  return 0;
 }
 
 // Look through buffer cache for block on device dev.
 // If not found, allocate a buffer.
-// In either case, return locked buffer.
+// In either case, return locked buffer. If every buffer is
+// in use, panic, or return 0 if canfail is set.
 static struct buf*
-bget(uint dev, uint blockno)
+bget(uint dev, uint blockno, int canfail)
 {
+  struct bucket *bk = bhash(dev, blockno);
   struct buf *b;
 
-  acquire(&bcache.lock);
+  acquire(&bk->lock);
 
   // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
+  for(b = bk->head; b; b = b->next){
     if(b->dev == dev && b->blockno == blockno){
       b->refcnt++;
-      release(&bcache.lock);
+      b->used = 1;
+      release(&bk->lock);
       acquiresleep(&b->lock);
       return b;
     }
   }
+  release(&bk->lock);
 
-  // Not cached.
-  // Recycle the least recently used (LRU) unused buffer.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->valid = 0;
-      b->refcnt = 1;
+  // Not cached. Look again with bcache.lock held, since
+  // another process may have cached it in the meantime.
+  acquire(&bcache.lock);
+  acquire(&bk->lock);
+  for(b = bk->head; b; b = b->next){
+    if(b->dev == dev && b->blockno == blockno){
+      b->refcnt++;
+      b->used = 1;
+      release(&bk->lock);
       release(&bcache.lock);
       acquiresleep(&b->lock);
       return b;
     }
   }
-  panic("bget: no buffers");
+
+  // Recycle an unused buffer.
+  if((b = bevict(bk)) == 0){
+    if(!canfail)
+      panic("bget: no buffers");
+    release(&bk->lock);
+    release(&bcache.lock);
+    return 0;
+  }
+  b->dev = dev;
+  b->blockno = blockno;
+  b->valid = 0;
+  b->refcnt = 1;
+  b->used = 1;
+  b->next = bk->head;
+  bk->head = b;
+  release(&bk->lock);
+  release(&bcache.lock);
+  acquiresleep(&b->lock);
+  return b;
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -94,25 +204,128 @@ bread(uint dev, uint blockno)
 {
   struct buf *b;
 
-  b = bget(dev, blockno);
+  b = bget(dev, blockno, 0);
   if(!b->valid) {
-    virtio_disk_rw(b, 0);
+    iosched_submit(b, 0, 0);
+    iosched_wait(b);
     b->valid = 1;
   }
+  if(b->readahead){
+    b->readahead = 0;
+    __sync_fetch_and_add(&bcache.rahit, 1);
+  }
   return b;
 }
 
+// Return a locked buf for the indicated block without reading
+// it, for a caller that will overwrite all of its data.
+struct buf*
+bnew(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  b = bget(dev, blockno, 0);
+  b->valid = 1;
+  return b;
+}
+
+// Start reading the indicated block into the cache, unless
+// it is cached already, and return without waiting for it.
+// Each pending prefetch holds a buffer until the disk is done
+// with it, so if an eighth of the cache is held that way, no
+// buffer is free, or the disk queue is full, the block is
+// simply not read.
+void
+breadahead(uint dev, uint blockno)
+{
+  struct bucket *bk = bhash(dev, blockno);
+  struct buf *b;
+
+  acquire(&bk->lock);
+  for(b = bk->head; b; b = b->next)
+    if(b->dev == dev && b->blockno == blockno)
+      break;
+  release(&bk->lock);
+  if(b)
+    return;
+
+  if(lockfree_read4(&bcache.rapending) >= bcache.nbuf / 8 ||
+     (b = bget(dev, blockno, 1)) == 0){
+    __sync_fetch_and_add(&bcache.radropped, 1);
+    return;
+  }
+  if(b->valid){
+    brelse(b);
+    return;
+  }
+  b->readahead = 1;
+  __sync_fetch_and_add(&bcache.rapending, 1);
+  if(iosched_trysubmit(b, 0, breaddone) < 0){
+    b->readahead = 0;
+    __sync_fetch_and_sub(&bcache.rapending, 1);
+    __sync_fetch_and_add(&bcache.radropped, 1);
+    brelse(b);
+    return;
+  }
+  __sync_fetch_and_add(&bcache.raissued, 1);
+}
+
+// Called by the disk interrupt handler when a read started
+// by breadahead() completes. Releases the buffer on behalf of
+// the process that started the read.
+void
+breaddone(struct buf *b)
+{
+  b->valid = 1;
+  __sync_fetch_and_sub(&bcache.rapending, 1);
+  releasesleep(&b->lock);
+
+  struct bucket *bk = bhash(b->dev, b->blockno);
+  acquire(&bk->lock);
+  b->refcnt--;
+  release(&bk->lock);
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
 {
   if(!holdingsleep(&b->lock))
     panic("bwrite");
-  virtio_disk_rw(b, 1);
+  iosched_submit(b, 1, 0);
+  iosched_wait(b);
+}
+
+// Start writing b's contents to disk, without waiting.
+// b must stay locked until a matching bwait(b).
+void
+bwrite_start(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("bwrite_start");
+  iosched_submit(b, 1, 0);
+}
+
+// Start writing the n locked bufs bs[] together, so that the
+// I/O scheduler can merge runs of consecutive blocks.
+// Each must be waited for with bwait().
+void
+bwritev_start(struct buf **bs, int n)
+{
+  for(int i = 0; i < n; i++)
+    if(!holdingsleep(&bs[i]->lock))
+      panic("bwritev_start");
+  iosched_submitv(bs, n, 1);
+}
+
+// Wait for a write started by bwrite_start() to finish.
+void
+bwait(struct buf *b)
+{
+  iosched_wait(b);
 }
 
 // Release a locked buffer.
-// Move to the head of the most-recently-used list.
 void
 brelse(struct buf *b)
 {
@@ -121,33 +334,78 @@ brelse(struct buf *b)
 
   releasesleep(&b->lock);
 
-  acquire(&bcache.lock);
+  // b->dev and b->blockno can't change while we hold a reference.
+  struct bucket *bk = bhash(b->dev, b->blockno);
+  acquire(&bk->lock);
   b->refcnt--;
-  if (b->refcnt == 0) {
-    // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
-  }
-  
-  release(&bcache.lock);
+  release(&bk->lock);
+}
+
+// Return a locked buf, not in the cache, holding a copy of
+// data for block blockno. Write it with bwrite_start() or
+// bwritev_start(), and free it with bshadowfree().
+struct buf*
+bshadow(uint dev, uint blockno, uchar *data)
+{
+  struct buf *b;
+
+  if((b = kmem_cache_alloc(bufcache)) == 0)
+    panic("bshadow");
+  memset(b, 0, sizeof(*b) - BSIZE);
+  b->dev = dev;
+  b->blockno = blockno;
+  b->valid = 1;
+  b->refcnt = 1;
+  memmove(b->data, data, BSIZE);
+  initsleeplock(&b->lock, "shadow");
+  acquiresleep(&b->lock);
+  return b;
+}
+
+// Free a buf from bshadow(). Its sleep lock never took a
+// slot in the lock stats table, so there is nothing to
+// freelock() before the memory goes back to the slab.
+void
+bshadowfree(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("bshadowfree");
+  releasesleep(&b->lock);
+  kmem_cache_free(bufcache, b);
+}
+
+// The number of buffers in the cache, for initlog().
+int
+bcachesize(void)
+{
+  return bcache.nbuf;
 }
 
 void
 bpin(struct buf *b) {
-  acquire(&bcache.lock);
+  struct bucket *bk = bhash(b->dev, b->blockno);
+  acquire(&bk->lock);
   b->refcnt++;
-  release(&bcache.lock);
+  release(&bk->lock);
 }
 
 void
 bunpin(struct buf *b) {
-  acquire(&bcache.lock);
+  struct bucket *bk = bhash(b->dev, b->blockno);
+  acquire(&bk->lock);
   b->refcnt--;
-  release(&bcache.lock);
+  release(&bk->lock);
 }
 
-
+// Print buffer cache and read-ahead counters into buf.
+int
+statsbio(char *buf, int sz)
+{
+  return snprintf(buf, sz, "--- buffer cache\n"
+                  "bcache: %d buffers, read-ahead %d issued %d hit %d wasted "
+                  "%d dropped\n",
+                  bcache.nbuf, lockfree_read4(&bcache.raissued),
+                  lockfree_read4(&bcache.rahit),
+                  lockfree_read4(&bcache.rawasted),
+                  lockfree_read4(&bcache.radropped));
+}
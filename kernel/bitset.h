@@ -8,15 +8,33 @@
 static inline void bit_set(uint64* bitset, uint64 pos) {
   uint64 idx = pos >> UINT64SHIFT;
   uint64 shift = pos & UINT64MASK;
-  bitset[idx] |= 1 << shift;
+  bitset[idx] |= 1UL << shift;
 }
 static inline int bit_get(uint64* bitset, uint64 pos) {
   uint64 idx = pos >> UINT64SHIFT;
   uint64 shift = pos & UINT64MASK;
-  return bitset[idx] & (1 << shift);
+  return (bitset[idx] >> shift) & 1;
 }
 static inline void bit_clear(uint64* bitset, uint64 pos) {
   uint64 idx = pos >> UINT64SHIFT;
   uint64 shift = pos & UINT64MASK;
-  bitset[idx] &= ~(1 << shift);
-}
\ No newline at end of file
+  bitset[idx] &= ~(1UL << shift);
+}
+// number of trailing zero bits in x, which must not be 0.
+static inline int bit_ctz(uint64 x) {
+  int n = 0;
+  if ((x & 0xffffffff) == 0) { n += 32; x >>= 32; }
+  if ((x & 0xffff) == 0) { n += 16; x >>= 16; }
+  if ((x & 0xff) == 0) { n += 8; x >>= 8; }
+  if ((x & 0xf) == 0) { n += 4; x >>= 4; }
+  if ((x & 0x3) == 0) { n += 2; x >>= 2; }
+  if ((x & 0x1) == 0) { n += 1; }
+  return n;
+}
+// number of one bits in x.
+static inline int bit_count(uint64 x) {
+  x = x - ((x >> 1) & 0x5555555555555555UL);
+  x = (x & 0x3333333333333333UL) + ((x >> 2) & 0x3333333333333333UL);
+  x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fUL;
+  return (x * 0x0101010101010101UL) >> 56;
+}
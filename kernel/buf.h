@@ -5,8 +5,15 @@ struct buf {
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
-  struct buf *prev; // LRU cache list
-  struct buf *next;
+  uint used;        // referenced since the eviction clock passed
+  int readahead;    // read by breadahead() and not yet bread()
+  int qbusy;        // queued or in flight in iosched
+  struct buf *qnext; // iosched queue
+  uint qtick;       // when queued
+  int qwrite;       // queued for writing?
+  void (*iodone)(struct buf *); // completion callback
+  int logseq;       // last transaction that logged it, or 0
+  struct buf *next; // hash bucket chain
   uchar data[BSIZE];
 };
 
@@ -8,21 +8,35 @@ struct pipe;
 struct proc;
 struct spinlock;
 struct sleeplock;
+struct rwsleeplock;
 struct stat;
+struct iovec;
 struct superblock;
 struct mbuf;
 struct sock;
 struct VMA;
+struct kmemstat;
+struct kmem_cache;
 struct usyscall {
   int pid;
 };
 // bio.c
 void binit(void);
 struct buf *bread(uint, uint);
+struct buf* bnew(uint, uint);
 void brelse(struct buf *);
 void bwrite(struct buf *);
+void bwrite_start(struct buf *);
+void bwritev_start(struct buf **, int);
+void bwait(struct buf *);
+struct buf* bshadow(uint, uint, uchar *);
+void bshadowfree(struct buf *);
 void bpin(struct buf *);
 void bunpin(struct buf *);
+int bcachesize(void);
+void breadahead(uint, uint);
+void breaddone(struct buf *);
+int statsbio(char *, int);
 
 // console.c
 void consoleinit(void);
@@ -38,8 +52,10 @@ void fileclose(struct file *);
 struct file *filedup(struct file *);
 void fileinit(void);
 int fileread(struct file *, uint64, int n);
+int filereadv(struct file *, struct iovec *, int, int);
 int filestat(struct file *, uint64 addr);
 int filewrite(struct file *, uint64, int n);
+int filewritev(struct file *, struct iovec *, int, int);
 
 // fs.c
 void fsinit(int);
@@ -49,6 +65,7 @@ struct inode *ialloc(uint, short);
 struct inode *idup(struct inode *);
 void iinit();
 void ilock(struct inode *);
+void ilock_shared(struct inode *);
 void iput(struct inode *);
 void iunlock(struct inode *);
 void iunlockput(struct inode *);
@@ -57,9 +74,15 @@ int namecmp(const char *, const char *);
 struct inode *namei(char *);
 struct inode *nameiparent(char *, char *);
 int readi(struct inode *, int, uint64, uint, uint);
+void ireadahead(struct inode *, uint, uint);
 void stati(struct inode *, struct stat *);
 int writei(struct inode *, int, uint64, uint, uint);
 void itrunc(struct inode *);
+void iflush(struct inode *);
+uint ibmap(struct inode *, uint);
+int dirunlink(struct inode *, char *, uint);
+int statsdcache(char *, int);
+int statsitable(char *, int);
 
 // ramdisk.c
 void ramdiskinit(void);
@@ -67,21 +90,31 @@ void ramdiskintr(void);
 void ramdiskrw(struct buf *);
 
 // kalloc.c
-void kpgfree(void *);
 void *kalloc(void);
+void *kalloc_zeroed(void);
+void kzeroidle(void);
+void *kalloc_order(int);
+void kfree_order(void *, int);
+void kalloc_selftest(void);
 void kfree(void *);
-void kmeminit(void *);
 void kinit(void);
 uint64 kgetfree(void);
+void kgetstats(struct kmemstat *);
 void *kgetpage(void *);
+int kgetref(void *);
 
 // log.c
 void initlog(int, struct superblock *);
 void log_write(struct buf *);
-void begin_op(void);
+void log_write_data(struct buf *);
+void begin_op(int);
 void end_op(void);
+int log_opmax(void);
+void log_sync(void);
+int statslog(char *, int);
 
 // pipe.c
+void pipeinit(void);
 int pipealloc(struct file **, struct file **);
 void pipeclose(struct pipe *, int);
 int piperead(struct pipe *, uint64, int);
@@ -111,6 +144,7 @@ void scheduler(void) __attribute__((noreturn));
 void sched(void);
 void sleep(void *, struct spinlock *);
 void userinit(void);
+void kthread_create(char *, void (*)(void));
 int wait(uint64);
 void wakeup(void *);
 void yield(void);
@@ -126,18 +160,25 @@ void swtch(struct context *, struct context *);
 void acquire(struct spinlock *);
 int holding(struct spinlock *);
 void initlock(struct spinlock *, char *);
+void initlock_unlisted(struct spinlock *, char *);
 void release(struct spinlock *);
 void push_off(void);
 void pop_off(void);
 uint64 lockfree_read8(uint64 *addr);
 int lockfree_read4(int *addr);
 void freelock(struct spinlock *);
+int statslock(char *, int);
 
 // sleeplock.c
 void acquiresleep(struct sleeplock *);
 void releasesleep(struct sleeplock *);
 int holdingsleep(struct sleeplock *);
 void initsleeplock(struct sleeplock *, char *);
+void initrwsleeplock(struct rwsleeplock *, char *);
+void acquireshared(struct rwsleeplock *);
+void acquireexcl(struct rwsleeplock *);
+void releaserw(struct rwsleeplock *);
+int holdingrw(struct rwsleeplock *);
 
 // string.c
 int memcmp(const void *, const void *, uint);
@@ -200,9 +241,21 @@ void plicinithart(void);
 int plic_claim(void);
 void plic_complete(int);
 
+// iosched.c
+void iosched_init(void);
+void iosched_submit(struct buf *, int, void (*)(struct buf *));
+void iosched_submitv(struct buf **, int, int);
+int iosched_trysubmit(struct buf *, int, void (*)(struct buf *));
+void iosched_wait(struct buf *);
+int statsiosched(char *, int);
+
 // virtio_disk.c
 void virtio_disk_init(void);
 void virtio_disk_rw(struct buf *, int);
+void virtio_disk_submit(struct buf *, int, void (*)(struct buf *));
+void virtio_disk_submitv(struct buf **, int, int, void (*)(struct buf *));
+int virtio_disk_trysubmitv(struct buf **, int, int, void (*)(struct buf *));
+void virtio_disk_wait(struct buf *);
 void virtio_disk_intr(void);
 
 // vmcopyin.c
@@ -210,8 +263,14 @@ int copyin_new(pagetable_t, char *, uint64, uint64);
 int copyinstr_new(pagetable_t, char *, uint64, uint64);
 
 // stats.c
-// void statsinit(void);
-// void statsinc(void);
+void statsinit(void);
+
+// slab.c
+void slabinit(void);
+struct kmem_cache *kmem_cache_create(char *, uint);
+void *kmem_cache_alloc(struct kmem_cache *);
+void kmem_cache_free(struct kmem_cache *, void *);
+int statsslab(char *, int);
 
 // sprintf.c
 int snprintf(char *, int, char *, ...);
@@ -227,6 +286,7 @@ void e1000_intr(void);
 int e1000_transmit(struct mbuf *);
 
 // net.c
+void mbufinit(void);
 void net_rx(struct mbuf *);
 void net_tx_udp(struct mbuf *, uint32, uint16, uint16);
 
@@ -15,4 +15,12 @@
 
 #define MAP_SHARED      0x01
 #define MAP_PRIVATE     0x02
+
+// one buffer of a readv() or writev()
+struct iovec {
+  void *base;  // user address
+  int len;
+};
+
+#define IOV_MAX 16  // most buffers per readv() or writev()
 #endif
@@ -12,6 +12,7 @@
 #include "file.h"
 #include "stat.h"
 #include "proc.h"
+#include "fcntl.h"
 extern int
 sockwrite(struct sock *si, uint64 addr, int n);
 extern int
@@ -79,7 +80,9 @@ fileclose(struct file *f)
   if(ff.type == FD_PIPE){
     pipeclose(ff.pipe, ff.writable);
   } else if(ff.type == FD_INODE || ff.type == FD_DEVICE){
-    begin_op();
+    if(ff.type == FD_INODE && ff.writable)
+      iflush(ff.ip);
+    begin_op(MAXOPBLOCKS);
     iput(ff.ip);
     end_op();
   }else if(ff.type == FD_SOCK){
@@ -96,7 +99,7 @@ filestat(struct file *f, uint64 addr)
   struct stat st;
   
   if(f->type == FD_INODE || f->type == FD_DEVICE){
-    ilock(f->ip);
+    ilock_shared(f->ip);
     stati(f->ip, &st);
     iunlock(f->ip);
     if(copyout(p->pagetable,p->vma, addr, (char *)&st, sizeof(st)) < 0)
@@ -106,93 +109,241 @@ filestat(struct file *f, uint64 addr)
   return -1;
 }
 
-// Read from file f.
-// addr is a user virtual address.
-int
-fileread(struct file *f, uint64 addr, int n)
+// Sequential read detection. A read that starts where the
+// previous one ended starts reading its blocks, plus a window
+// of blocks beyond, before readi() waits for the first; at
+// most RAWINDOW blocks per read, so that a big read doesn't
+// tie up the cache. The window doubles with each sequential
+// read, up to RAWINDOW, and closes on a seek. Caller must hold f->ip->lock, and
+// must have f to itself if it holds it shared.
+static void
+readahead(struct file *f, int n)
 {
-  int r = 0;
+  uint bn, end;
 
-  if(f->readable == 0)
-    return -1;
+  if(n <= 0)
+    return;
+  if(f->off != f->ranext){
+    f->rawin = 0;
+    f->raend = 0;
+    f->ranext = f->off + n;
+    return;
+  }
+  f->ranext = f->off + n;
+  f->rawin = f->rawin ? f->rawin * 2 : 2;
+  if(f->rawin > RAWINDOW)
+    f->rawin = RAWINDOW;
 
+  bn = f->off / BSIZE;
+  end = (f->off + n - 1) / BSIZE + 1 + f->rawin;
+  if(bn < f->raend)
+    bn = f->raend;
+  if(bn < end){
+    if(end - bn > RAWINDOW)
+      end = bn + RAWINDOW;
+    ireadahead(f->ip, bn, end - bn);
+    f->raend = end;
+  }
+}
+
+// Read up to n bytes from a pipe, device or socket.
+static int
+readstream(struct file *f, uint64 addr, int n)
+{
   if(f->type == FD_PIPE){
-    r = piperead(f->pipe, addr, n);
+    return piperead(f->pipe, addr, n);
   } else if(f->type == FD_DEVICE){
     if(f->major < 0 || f->major >= NDEV || !devsw[f->major].read)
       return -1;
-    r = devsw[f->major].read(1, addr, n);
-  } else if(f->type == FD_INODE){
-    ilock(f->ip);
-    if((r = readi(f->ip, 1, addr, f->off, n)) > 0){
-      f->off += r;
-    }
-    else{
-      iunlock(f->ip);
-      return r;
-    }
-    iunlock(f->ip);
+    return devsw[f->major].read(1, addr, n);
+  } else if(f->type == FD_SOCK){
+    return sockread(f->sock, addr, n);
+  }
+  panic("fileread");
+}
+
+// Write n bytes to a pipe, device or socket.
+static int
+writestream(struct file *f, uint64 addr, int n)
+{
+  if(f->type == FD_PIPE){
+    return pipewrite(f->pipe, addr, n);
+  } else if(f->type == FD_DEVICE){
+    if(f->major < 0 || f->major >= NDEV || !devsw[f->major].write)
+      return -1;
+    return devsw[f->major].write(1, addr, n);
   } else if(f->type == FD_SOCK){
-    r = sockread(f->sock, addr, n);
+    return sockwrite(f->sock, addr, n);
   }
-  else {
-    panic("fileread");
+  panic("filewrite");
+}
+
+// Read from file f into the iovcnt buffers of iov, filling
+// each before the next. The buffers are user virtual
+// addresses. Reads at offset off, or at f->off, advancing it,
+// if off < 0; only inodes have offsets.
+// Returns the number of bytes read, or -1.
+int
+filereadv(struct file *f, struct iovec *iov, int iovcnt, int off)
+{
+  int i, r = 0, tot = 0;
+  uint pos;
+
+  if(f->readable == 0)
+    return -1;
+  if(off >= 0 && f->type != FD_INODE)
+    return -1;
+
+  if(f->type != FD_INODE){
+    for(i = 0; i < iovcnt; i++){
+      if((r = readstream(f, (uint64)iov[i].base, iov[i].len)) < 0)
+        break;
+      tot += r;
+      if(r < iov[i].len)
+        break;
+    }
+    return r < 0 && tot == 0 ? -1 : tot;
   }
 
-  return r;
+  // f->off and the read-ahead state belong to f, so readers
+  // of the inode can share its lock only if they don't use
+  // them or f isn't shared: with f->ref == 1 it's this
+  // process's alone, and it's in this system call.
+  if(off >= 0 || f->ref == 1)
+    ilock_shared(f->ip);
+  else
+    ilock(f->ip);
+  if(off < 0){
+    for(i = 0; i < iovcnt; i++)
+      tot += iov[i].len;
+    readahead(f, tot);
+    tot = 0;
+  }
+  pos = off < 0 ? f->off : off;
+  for(i = 0; i < iovcnt; i++){
+    if((r = readi(f->ip, 1, (uint64)iov[i].base, pos, iov[i].len)) < 0)
+      break;
+    pos += r;
+    tot += r;
+    if(r < iov[i].len)
+      break;
+  }
+  if(off < 0)
+    f->off += tot;
+  iunlock(f->ip);
+  return r < 0 && tot == 0 ? -1 : tot;
 }
 
-// Write to file f.
+// Read from file f.
 // addr is a user virtual address.
 int
-filewrite(struct file *f, uint64 addr, int n)
+fileread(struct file *f, uint64 addr, int n)
+{
+  struct iovec iov = { (void*)addr, n };
+
+  return filereadv(f, &iov, 1, -1);
+}
+
+// Write the iovcnt buffers of iov, user virtual addresses,
+// to file f in order, at offset off, or at f->off, advancing
+// it, if off < 0; only inodes have offsets.
+// Returns the number of bytes written, or -1 if it couldn't
+// write them all to an inode.
+int
+filewritev(struct file *f, struct iovec *iov, int iovcnt, int off)
 {
-  int r, ret = 0;
+  int i, r = 0, tot = 0;
 
   if(f->writable == 0)
     return -1;
-
-  if(f->type == FD_PIPE){
-    ret = pipewrite(f->pipe, addr, n);
-  } else if(f->type == FD_DEVICE){
-    if(f->major < 0 || f->major >= NDEV || !devsw[f->major].write)
+  if(off >= 0 && f->type != FD_INODE)
+    return -1;
+  for(i = 0; i < iovcnt; i++)
+    if(iov[i].len < 0)
       return -1;
-    ret = devsw[f->major].write(1, addr, n);
-  } else if(f->type == FD_INODE){
-    // write a few blocks at a time to avoid exceeding
-    // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
-    // this really belongs lower down, since writei()
-    // might be writing a device like the console.
-    int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
-    int i = 0;
-    while(i < n){
-      int n1 = n - i;
-      if(n1 > max)
-        n1 = max;
-
-      begin_op();
-      ilock(f->ip);
-      if ((r = writei(f->ip, 1, addr + i, f->off, n1)) > 0)
-        f->off += r;
-      iunlock(f->ip);
-      end_op();
 
+  if(f->type != FD_INODE){
+    for(i = 0; i < iovcnt; i++){
+      if((r = writestream(f, (uint64)iov[i].base, iov[i].len)) < 0)
+        break;
+      tot += r;
+      if(r < iov[i].len)
+        break;
+    }
+    return r < 0 && tot == 0 ? -1 : tot;
+  }
+
+  // write as many blocks at a time as one op may log,
+  // counting the i-node, indirect block, allocation
+  // blocks, and 2 blocks of slop for non-aligned writes.
+  // each transaction, and each ilock(), covers as much
+  // of the iovec as fits, since the buffers go to
+  // consecutive bytes of the file.
+  // this really belongs lower down, since writei()
+  // might be writing a device like the console.
+  int max = ((log_opmax()-1-1-2) / 2) * BSIZE;
+  int done = 0;  // bytes of iov[i] written
+  int j, n, n1, full, err = 0;
+  uint pos;
+
+  i = 0;
+  while(!err){
+    while(i < iovcnt && done == iov[i].len){
+      i++;
+      done = 0;
+    }
+    if(i == iovcnt)
+      break;
+    for(n = -done, j = i; j < iovcnt && n < max; j++)
+      n += iov[j].len;
+    if(n > max)
+      n = max;
+
+    begin_op(WRITEOPBLOCKS(n));
+    ilock(f->ip);
+    pos = off < 0 ? f->off : off + tot;
+    while(n > 0){
+      n1 = iov[i].len - done;
+      if(n1 > n)
+        n1 = n;
+      if((r = writei(f->ip, 1, (uint64)iov[i].base + done, pos, n1)) > 0){
+        pos += r;
+        tot += r;
+        done += r;
+        n -= r;
+        if(off < 0)
+          f->off += r;
+      }
       if(r != n1){
-        // error from writei
+        // error from writei, unless it stopped because
+        // the delayed blocks are full.
+        err = !(f->ip->ndelay == NDELAY && r >= 0);
         break;
       }
-      i += r;
+      if(done == iov[i].len){
+        i++;
+        done = 0;
+      }
     }
-    ret = (i == n ? n : -1);
-  } else if(f->type == FD_SOCK){
-    ret = sockwrite(f->sock, addr, n);
-  }
-  else {
-    panic("filewrite");
+    full = f->ip->ndelay == NDELAY;
+    iunlock(f->ip);
+    end_op();
+
+    // allocate the file's delayed blocks once there
+    // is no room for more.
+    if(full)
+      iflush(f->ip);
   }
+  return err ? -1 : tot;
+}
+
+// Write to file f.
+// addr is a user virtual address.
+int
+filewrite(struct file *f, uint64 addr, int n)
+{
+  struct iovec iov = { (void*)addr, n };
 
-  return ret;
+  return filewritev(f, &iov, 1, -1);
 }
 
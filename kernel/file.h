@@ -8,6 +8,9 @@ struct file {
   struct inode *ip;  // FD_INODE and FD_DEVICE
   struct sock *sock; // FD_SOCK
   uint off;          // FD_INODE
+  uint ranext;       // FD_INODE: offset a sequential read would start at
+  uint raend;        // FD_INODE: first block not yet read ahead
+  int rawin;         // FD_INODE: current read-ahead window, in blocks
   short major;       // FD_DEVICE
   
 };
@@ -21,17 +24,33 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
-  struct sleeplock lock; // protects everything below here
+  struct inode *next;    // hash chain
+  struct inode *lrunext; // unreferenced inodes, most recently used first
+  struct inode *lruprev;
+  struct rwsleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
   short type;         // copy of disk inode
+  short extents;      // addrs[] holds extents (DI_EXTENTS)
+  short hashed;       // directory has a hash index (DI_HASHED)
   short major;
   short minor;
   short nlink;
   uint size;
   uint addrs[NDIRECT+NINDIRECT+NDINDIRECT];
+
+  // with extents, blocks from dstart on have no disk block
+  // yet; their data waits in delay[] until iflush().
+  uint dstart;
+  int ndelay;
+  char *delay[NDELAY];
 };
 
+// the most blocks a writei() of n bytes may log: the i-node,
+// an indirect block, 2 blocks of slop for a non-aligned write,
+// and each data block with its allocation block.
+#define WRITEOPBLOCKS(n) (1 + 1 + 2 + 2 * (((n) + BSIZE - 1) / BSIZE))
+
 // map major device number to device functions.
 struct devsw {
   int (*read)(int, uint64, int);
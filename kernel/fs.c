@@ -20,8 +20,12 @@
 #include "fs.h"
 #include "buf.h"
 #include "file.h"
+#include "bitset.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
+#define EXTRUN 16  // new extents start at an aligned free run at least this long
+#define MAXBMAP 64        // most bitmap blocks the free summary covers
+#define MAXIBLOCKS 1024   // most inode blocks the free summary covers
 // there should be one superblock per disk device, but we run with
 // only one device
 struct superblock sb; 
@@ -37,6 +41,25 @@ readsb(int dev, struct superblock *sb)
   brelse(bp);
 }
 
+// In-memory summary of free space, so that allocation
+// skips bitmap and inode blocks with nothing free. A bitmap
+// block's count is exact: it changes with the bitmap, under
+// the bitmap block's lock. An inode block's count is a hint,
+// recounted whenever ialloc() reads the block.
+struct {
+  struct spinlock lock;
+  int nbmap;              // bitmap blocks
+  int bfree[MAXBMAP];     // free blocks per bitmap block
+  uint bnext;             // next-fit cursor for balloc()
+  int niblocks;           // inode blocks
+  short ifree[MAXIBLOCKS]; // free inodes per inode block; -1 if not counted
+  uint inext;             // next-fit cursor for ialloc()
+  int nfree;              // free blocks in all
+  int ndelay;             // of those, promised to delayed blocks
+} fsum;
+
+static void fsuminit(int dev);
+
 // Init fs
 void
 fsinit(int dev) {
@@ -44,42 +67,140 @@ fsinit(int dev) {
   if(sb.magic != FSMAGIC)
     panic("invalid file system");
   initlog(dev, &sb);
+  fsuminit(dev);
+}
+
+// Count the free blocks in each bitmap block, after log
+// recovery. Bits past the end of the disk don't count.
+static void
+fsuminit(int dev)
+{
+  struct buf *bp;
+  uint64 *w;
+  int g, i, n;
+
+  initlock(&fsum.lock, "fsum");
+  fsum.nbmap = (sb.size + BPB - 1) / BPB;
+  fsum.niblocks = (sb.ninodes + IPB - 1) / IPB;
+  if(fsum.nbmap > MAXBMAP || fsum.niblocks > MAXIBLOCKS)
+    panic("fsuminit: file system too big");
+  for(g = 0; g < fsum.nbmap; g++){
+    bp = bread(dev, sb.bmapstart + g);
+    w = (uint64*)bp->data;
+    n = 0;
+    for(i = 0; i < BPB/64 && g*BPB + i*64 < sb.size; i++){
+      uint64 used = w[i];
+      if(g*BPB + (i+1)*64 > sb.size)
+        used |= ~0UL << (sb.size - g*BPB - i*64);
+      n += 64 - bit_count(used);
+    }
+    fsum.bfree[g] = n;
+    fsum.nfree += n;
+    brelse(bp);
+  }
+  for(i = 0; i < fsum.niblocks; i++)
+    fsum.ifree[i] = -1;
+}
+
+// Account for n blocks allocated (n > 0) or freed (n < 0)
+// in bitmap block g. Caller must hold the bitmap block.
+static void
+fsum_blocks(int g, int n)
+{
+  acquire(&fsum.lock);
+  fsum.bfree[g] -= n;
+  fsum.nfree -= n;
+  release(&fsum.lock);
+}
+
+// Does bitmap block g have at least n free blocks?
+static int
+fsum_hasfree(int g, int n)
+{
+  int r;
+
+  acquire(&fsum.lock);
+  r = fsum.bfree[g] >= n;
+  release(&fsum.lock);
+  return r;
+}
+
+// Promise n free blocks to delayed blocks, so that iflush()
+// won't run out of space; n < 0 takes the promise back.
+// returns 0 if there aren't that many to promise.
+static int
+fsum_reserve(int n)
+{
+  int r;
+
+  acquire(&fsum.lock);
+  r = n <= 0 || fsum.nfree - fsum.ndelay >= n;
+  if(r)
+    fsum.ndelay += n;
+  release(&fsum.lock);
+  return r;
 }
 
-// Zero a block.
+// Zero a newly allocated block. Nothing on disk refers to
+// it yet, so in ordered mode the zeros go home with the
+// commit like file data instead of through the log. A caller
+// that makes it an indirect, extent or directory block
+// log_write()s it afterwards, which moves it into the log.
 static void
 bzero(int dev, int bno)
 {
   struct buf *bp;
 
-  bp = bread(dev, bno);
+  bp = bnew(dev, bno);
   memset(bp->data, 0, BSIZE);
-  log_write(bp);
+  log_write_data(bp);
   brelse(bp);
 }
 
 // Blocks.
 
-// Allocate a zeroed disk block.
+// Allocate a zeroed disk block: the first free one from
+// just after the last block balloc() allocated on (next fit),
+// skipping full bitmap blocks, and scanning a word at a time.
 // returns 0 if out of disk space.
 static uint
 balloc(uint dev)
 {
-  int b, bi, m;
+  int n, g, i, first;
+  uint b, start;
+  uint64 *w, avail;
   struct buf *bp;
 
-  bp = 0;
-  for(b = 0; b < sb.size; b += BPB){
-    bp = bread(dev, BBLOCK(b, sb));
-    for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
-      m = 1 << (bi % 8);
-      if((bp->data[bi/8] & m) == 0){  // Is block free?
-        bp->data[bi/8] |= m;  // Mark block in use.
-        log_write(bp);
-        brelse(bp);
-        bzero(dev, b + bi);
-        return b + bi;
-      }
+  acquire(&fsum.lock);
+  start = fsum.bnext < sb.size ? fsum.bnext : 0;
+  release(&fsum.lock);
+
+  // the last pass looks at the start of the first bitmap block.
+  for(n = 0; n <= fsum.nbmap; n++){
+    g = (start / BPB + n) % fsum.nbmap;
+    if(!fsum_hasfree(g, 1))
+      continue;
+    bp = bread(dev, sb.bmapstart + g);
+    w = (uint64*)bp->data;
+    first = n == 0 ? (start % BPB) / 64 : 0;
+    for(i = first; i < BPB/64; i++){
+      avail = ~w[i];
+      if(n == 0 && i == first)
+        avail &= ~0UL << (start % 64);
+      if(avail == 0)
+        continue;
+      b = g*BPB + i*64 + bit_ctz(avail);
+      if(b >= sb.size)
+        break;
+      w[i] |= 1UL << (b % 64);  // Mark block in use.
+      log_write(bp);
+      fsum_blocks(g, 1);
+      brelse(bp);
+      acquire(&fsum.lock);
+      fsum.bnext = b + 1;
+      release(&fsum.lock);
+      bzero(dev, b);
+      return b;
     }
     brelse(bp);
   }
@@ -87,6 +208,75 @@ balloc(uint dev)
   return 0;
 }
 
+// Allocate zeroed disk block b, if it is free.
+// returns 0 if it isn't.
+static uint
+balloc_at(uint dev, uint b)
+{
+  struct buf *bp;
+  int bi, m;
+
+  if(b >= sb.size)
+    return 0;
+  bp = bread(dev, BBLOCK(b, sb));
+  bi = b % BPB;
+  m = 1 << (bi % 8);
+  if(bp->data[bi/8] & m){
+    brelse(bp);
+    return 0;
+  }
+  bp->data[bi/8] |= m;
+  log_write(bp);
+  fsum_blocks(b / BPB, 1);
+  brelse(bp);
+  bzero(dev, b);
+  return b;
+}
+
+// Allocate a zeroed disk block to start a new extent: the
+// first block of an aligned run of want free blocks (a power
+// of two, at least EXTRUN) at or after goal, wrapping around,
+// so that the extent has room to grow; or of the longest such
+// run there is; or else any free block.
+// returns 0 if out of disk space.
+static uint
+balloc_run(uint dev, int want, uint goal)
+{
+  int b, bi, k, n, ng;
+  uint g;
+  struct buf *bp;
+
+  ng = (sb.size + BPB - 1) / BPB;
+  for(; want >= EXTRUN; want /= 2){
+    g = (goal + want - 1) / want * want;
+    if(g >= sb.size)
+      g = 0;
+    for(n = 0; n <= ng; n++){
+      b = (g / BPB + n) % ng * BPB;
+      if(!fsum_hasfree(b / BPB, want))
+        continue;
+      bp = bread(dev, BBLOCK(b, sb));
+      for(bi = n == 0 ? g % BPB : 0; bi < BPB && b + bi + want <= sb.size; bi += want){
+        if(n == ng && b + bi >= g)
+          break;  // back at goal
+        for(k = 0; k < want/8; k++)
+          if(bp->data[bi/8 + k])
+            break;
+        if(k == want/8){  // whole run free?
+          bp->data[bi/8] |= 1;
+          log_write(bp);
+          fsum_blocks(b / BPB, 1);
+          brelse(bp);
+          bzero(dev, b + bi);
+          return b + bi;
+        }
+      }
+      brelse(bp);
+    }
+  }
+  return balloc(dev);
+}
+
 // Free a disk block.
 static void
 bfree(int dev, uint b)
@@ -101,15 +291,45 @@ bfree(int dev, uint b)
     panic("freeing free block");
   bp->data[bi/8] &= ~m;
   log_write(bp);
+  fsum_blocks(b / BPB, -1);
   brelse(bp);
 }
 
+// Free the n disk blocks from b on, updating each
+// bitmap block once.
+static void
+bfree_run(int dev, uint b, uint n)
+{
+  struct buf *bp;
+  int bi, m, k;
+
+  while(n > 0){
+    bp = bread(dev, BBLOCK(b, sb));
+    k = 0;
+    do {
+      bi = b % BPB;
+      m = 1 << (bi % 8);
+      if((bp->data[bi/8] & m) == 0)
+        panic("freeing free block");
+      bp->data[bi/8] &= ~m;
+      b++;
+      n--;
+      k++;
+    } while(n > 0 && b % BPB != 0);
+    log_write(bp);
+    fsum_blocks((b - 1) / BPB, -k);
+    brelse(bp);
+  }
+}
+
 // Inodes.
 //
 // An inode describes a single unnamed file.
 // The inode disk structure holds metadata: the file's type,
 // its size, the number of links referring to it, and the
-// list of blocks holding the file's content.
+// list of blocks holding the file's content. A regular
+// file's blocks are listed as extents, runs of consecutive
+// blocks; other inodes list block numbers.
 //
 // The inodes are laid out sequentially on disk at block
 // sb.inodestart. Each inode has a number, indicating its
@@ -140,7 +360,16 @@ bfree(int dev, uint b)
 //   table entry is only correct when ip->valid is 1.
 //   ilock() reads the inode from
 //   the disk and sets ip->valid, while iput() clears
-//   ip->valid if ip->ref has fallen to zero.
+//   ip->valid if it frees the inode.
+//
+// * Cached: when ip->ref falls to zero, a valid entry stays
+//   in the table, on a list of unreferenced entries in
+//   least recently used order, so that the next iget() of
+//   that inode finds it without ilock() reading the disk.
+//   Up to NINODE entries are kept this way; entries beyond
+//   that, and ones that aren't valid, go back to the slab
+//   allocator, so the table holds as many referenced
+//   entries as memory allows.
 //
 // * Locked: file system code may only examine and modify
 //   the information in an inode and its content if it
@@ -165,28 +394,76 @@ bfree(int dev, uint b)
 // multi-step atomic operations.
 //
 // The itable.lock spin-lock protects the allocation of itable
-// entries. Since ip->ref indicates whether an entry is free,
+// entries, the hash chains and the list of unreferenced
+// entries. Since ip->ref indicates whether an entry is in use,
 // and ip->dev and ip->inum indicate which i-node an entry
 // holds, one must hold itable.lock while using any of those fields.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
+// ilock_shared() holds it shared, which is enough for reading
+// them; writing them needs ilock().
+
+#define NIHASH 127
 
 struct {
   struct spinlock lock;
-  struct inode inode[NINODE];
+  struct inode *bucket[NIHASH];  // entries by (dev, inum)
+  struct inode lru;       // head of the list of unreferenced entries
+  int n;                  // entries in the table
+  int ncached;            // of those, unreferenced
+  uint64 hits;            // iget()s that found a cached entry
+  uint64 misses;          // iget()s that made a new one
 } itable;
 
+static struct kmem_cache *inodecache;
+
+static struct kmem_cache *delaycache;  // data of delayed blocks
+
+static void dcache_init(void);
+static void dcache_purge(uint dev, uint inum);
+
 void
 iinit()
 {
-  int i = 0;
-  
   initlock(&itable.lock, "itable");
-  for(i = 0; i < NINODE; i++) {
-    initsleeplock(&itable.inode[i].lock, "inode");
-  }
+  itable.lru.lrunext = &itable.lru;
+  itable.lru.lruprev = &itable.lru;
+  dcache_init();
+  inodecache = kmem_cache_create("inode", sizeof(struct inode));
+  delaycache = kmem_cache_create("delay", BSIZE);
+}
+
+static struct inode**
+ihash(uint dev, uint inum)
+{
+  return &itable.bucket[(dev ^ inum) % NIHASH];
+}
+
+// Caller must hold itable.lock.
+static void
+lru_remove(struct inode *ip)
+{
+  ip->lrunext->lruprev = ip->lruprev;
+  ip->lruprev->lrunext = ip->lrunext;
+  itable.ncached--;
+}
+
+// Remove ip from the table and free it. ip->lock is an
+// unlisted lock (see initlock_unlisted()), so a recycled
+// slab object can be initialized again without freelock().
+// Caller must hold itable.lock.
+static void
+ifree(struct inode *ip)
+{
+  struct inode **pp;
+
+  for(pp = ihash(ip->dev, ip->inum); *pp != ip; pp = &(*pp)->next)
+    ;
+  *pp = ip->next;
+  itable.n--;
+  kmem_cache_free(inodecache, ip);
 }
 
 static struct inode* iget(uint dev, uint inum);
@@ -195,24 +472,56 @@ static struct inode* iget(uint dev, uint inum);
 // Mark it as allocated by  giving it type type.
 // Returns an unlocked but allocated and referenced inode,
 // or NULL if there is no free inode.
+// Looks from the inode block of the last allocation on,
+// skipping blocks known to have no free inodes.
 struct inode*
 ialloc(uint dev, short type)
 {
-  int inum;
+  int n, blk, i, inum, found, nfree;
+  uint start;
   struct buf *bp;
   struct dinode *dip;
 
-  for(inum = 1; inum < sb.ninodes; inum++){
-    bp = bread(dev, IBLOCK(inum, sb));
-    dip = (struct dinode*)bp->data + inum%IPB;
-    if(dip->type == 0){  // a free inode
+  acquire(&fsum.lock);
+  start = fsum.inext;
+  release(&fsum.lock);
+
+  for(n = 0; n < fsum.niblocks; n++){
+    blk = (start / IPB + n) % fsum.niblocks;
+    acquire(&fsum.lock);
+    nfree = fsum.ifree[blk];
+    release(&fsum.lock);
+    if(nfree == 0)
+      continue;
+    bp = bread(dev, IBLOCK(blk * IPB, sb));
+    found = 0;
+    nfree = 0;
+    for(i = 0; i < IPB; i++){
+      inum = blk * IPB + i;
+      dip = (struct dinode*)bp->data + i;
+      if(inum == 0 || inum >= sb.ninodes || dip->type != 0)
+        continue;
+      if(found == 0)
+        found = inum;
+      else
+        nfree++;
+    }
+    if(found){  // a free inode
+      dip = (struct dinode*)bp->data + found%IPB;
       memset(dip, 0, sizeof(*dip));
       dip->type = type;
+      if(type == T_FILE)
+        dip->type |= DI_EXTENTS;
       log_write(bp);   // mark it allocated on the disk
-      brelse(bp);
-      return iget(dev, inum);
     }
+    acquire(&fsum.lock);
+    fsum.ifree[blk] = nfree;
+    if(found)
+      fsum.inext = found;
+    release(&fsum.lock);
     brelse(bp);
+    if(found)
+      return iget(dev, found);
   }
   printf("ialloc: no inodes\n");
   return 0;
@@ -230,11 +539,13 @@ iupdate(struct inode *ip)
 
   bp = bread(ip->dev, IBLOCK(ip->inum, sb));
   dip = (struct dinode*)bp->data + ip->inum%IPB;
-  dip->type = ip->type;
+  dip->type = ip->type | (ip->extents ? DI_EXTENTS : 0) |
+    (ip->hashed ? DI_HASHED : 0);
   dip->major = ip->major;
   dip->minor = ip->minor;
   dip->nlink = ip->nlink;
-  dip->size = ip->size;
+  // delayed blocks aren't on disk yet.
+  dip->size = ip->extents ? min(ip->size, ip->dstart*BSIZE) : ip->size;
   memmove(dip->addrs, ip->addrs, sizeof(ip->addrs));
   log_write(bp);
   brelse(bp);
@@ -246,31 +557,44 @@ iupdate(struct inode *ip)
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct inode *ip, **pp;
 
   acquire(&itable.lock);
 
   // Is the inode already in the table?
-  empty = 0;
-  for(ip = &itable.inode[0]; ip < &itable.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
+  for(ip = *ihash(dev, inum); ip; ip = ip->next){
+    if(ip->dev == dev && ip->inum == inum){
+      if(ip->ref == 0){
+        lru_remove(ip);
+        itable.hits++;
+      }
       ip->ref++;
       release(&itable.lock);
       return ip;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
   }
 
-  // Recycle an inode entry.
-  if(empty == 0)
+  // Make a new entry, or, if out of memory, recycle the
+  // least recently used unreferenced one.
+  if((ip = kmem_cache_alloc(inodecache)) == 0 && itable.ncached > 0){
+    ip = itable.lru.lruprev;
+    lru_remove(ip);
+    ifree(ip);
+    ip = kmem_cache_alloc(inodecache);
+  }
+  if(ip == 0)
     panic("iget: no inodes");
-
-  ip = empty;
+  memset(ip, 0, sizeof(*ip));
+  initrwsleeplock(&ip->lock, "inode");
+  itable.n++;
+  itable.misses++;
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  pp = ihash(dev, inum);
+  ip->next = *pp;
+  *pp = ip;
   release(&itable.lock);
 
   return ip;
@@ -298,17 +622,20 @@ ilock(struct inode *ip)
   if(ip == 0 || ip->ref < 1)
     panic("ilock");
 
-  acquiresleep(&ip->lock);
+  acquireexcl(&ip->lock);
 
   if(ip->valid == 0){
     bp = bread(ip->dev, IBLOCK(ip->inum, sb));
     dip = (struct dinode*)bp->data + ip->inum%IPB;
-    ip->type = dip->type;
+    ip->type = DI_TYPE(dip->type);
+    ip->extents = (dip->type & DI_EXTENTS) != 0;
+    ip->hashed = (dip->type & DI_HASHED) != 0;
     ip->major = dip->major;
     ip->minor = dip->minor;
     ip->nlink = dip->nlink;
     ip->size = dip->size;
     memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
+    ip->dstart = (ip->size + BSIZE - 1) / BSIZE;
     brelse(bp);
     ip->valid = 1;
     if(ip->type == 0)
@@ -316,14 +643,34 @@ ilock(struct inode *ip)
   }
 }
 
-// Unlock the given inode.
+// Lock the given inode shared, for callers that only read
+// it: readi(), stati(), dirlookup() and the like. Any number
+// of processes may hold it shared at once.
+void
+ilock_shared(struct inode *ip)
+{
+  if(ip == 0 || ip->ref < 1)
+    panic("ilock_shared");
+
+  for(;;){
+    acquireshared(&ip->lock);
+    if(ip->valid)
+      return;
+    // reading the inode from disk writes ip's fields.
+    releaserw(&ip->lock);
+    ilock(ip);
+    iunlock(ip);
+  }
+}
+
+// Unlock the given inode, locked either way.
 void
 iunlock(struct inode *ip)
 {
-  if(ip == 0 || !holdingsleep(&ip->lock) || ip->ref < 1)
+  if(ip == 0 || !holdingrw(&ip->lock) || ip->ref < 1)
     panic("iunlock");
 
-  releasesleep(&ip->lock);
+  releaserw(&ip->lock);
 }
 
 // Drop a reference to an in-memory inode.
@@ -338,26 +685,54 @@ iput(struct inode *ip)
 {
   acquire(&itable.lock);
 
+  // the last writer's fileclose() called iflush().
+  if(ip->ref == 1 && ip->ndelay > 0 && ip->nlink > 0)
+    panic("iput: delayed blocks");
+
   if(ip->ref == 1 && ip->valid && ip->nlink == 0){
     // inode has no links and no other references: truncate and free.
 
     // ip->ref == 1 means no other process can have ip locked,
-    // so this acquiresleep() won't block (or deadlock).
-    acquiresleep(&ip->lock);
+    // so this acquireexcl() won't block (or deadlock).
+    acquireexcl(&ip->lock);
 
     release(&itable.lock);
 
+    if(ip->type == T_DIR)
+      dcache_purge(ip->dev, ip->inum);
     itrunc(ip);
     ip->type = 0;
+    ip->extents = 0;
+    ip->hashed = 0;
     iupdate(ip);
     ip->valid = 0;
 
-    releasesleep(&ip->lock);
+    acquire(&fsum.lock);
+    if(fsum.ifree[ip->inum / IPB] >= 0)
+      fsum.ifree[ip->inum / IPB]++;
+    release(&fsum.lock);
+
+    releaserw(&ip->lock);
 
     acquire(&itable.lock);
   }
 
-  ip->ref--;
+  if(--ip->ref == 0){
+    if(ip->valid){
+      // keep it, most recently used first.
+      ip->lrunext = itable.lru.lrunext;
+      ip->lruprev = &itable.lru;
+      ip->lrunext->lruprev = ip;
+      itable.lru.lrunext = ip;
+      if(++itable.ncached > NINODE){
+        ip = itable.lru.lruprev;
+        lru_remove(ip);
+        ifree(ip);
+      }
+    } else {
+      ifree(ip);
+    }
+  }
   release(&itable.lock);
 }
 
@@ -369,12 +744,111 @@ iunlockput(struct inode *ip)
   iput(ip);
 }
 
+// Print inode table counters into buf.
+int
+statsitable(char *buf, int sz)
+{
+  uint64 total;
+  int n;
+
+  acquire(&itable.lock);
+  total = itable.hits + itable.misses;
+  n = snprintf(buf, sz, "--- inode table\n"
+               "itable: entries %d referenced %d cached %d hits %d misses %d hit rate %d%%\n",
+               itable.n, itable.n - itable.ncached, itable.ncached,
+               (int)itable.hits, (int)itable.misses,
+               total ? (int)(itable.hits * 100 / total) : 0);
+  release(&itable.lock);
+  return n;
+}
+
 // Inode content
 //
 // The content (data) associated with each inode is stored
 // in blocks on the disk. The first NDIRECT block numbers
 // are listed in ip->addrs[].  The next NINDIRECT blocks are
 // listed in block ip->addrs[NDIRECT].
+//
+// In an inode with extents, ip->addrs[] holds the first
+// NEXTENT extents, and block ip->addrs[EXTBLK] the next
+// NEXTENTBLK. A file grows by extending its last extent
+// when the following disk block is free, and otherwise by
+// starting a new one after it where there is room to grow to
+// twice its length, so that a file written along with others
+// still needs only a few extents. A file's first extent goes
+// in a part of the disk picked by its i-number, away from
+// other files being written at the same time.
+//
+// writei() doesn't allocate blocks past the end of a file
+// with extents. Their data waits in memory, up to NDELAY
+// blocks, until iflush() allocates them all at once, so that
+// a file written a little at a time, interleaved with other
+// files, still gets long runs of blocks.
+
+// Return the disk block address of the nth block in
+// inode ip, which has extents, appending a block if bn
+// is the first block past the end. n is the number of
+// blocks about to be appended, from bn on.
+// returns 0 if out of disk space or extents.
+static uint
+bmap_extent(struct inode *ip, uint bn, int n)
+{
+  struct extent *ie = (struct extent*)ip->addrs, *be = 0;
+  struct extent *x = 0, *last = 0;
+  struct buf *bp = 0;
+  uint addr = 0, goal;
+  int i, want, dirty = 0;
+
+  for(i = 0; i < NEXTENT + NEXTENTBLK; i++){
+    if(i == NEXTENT){
+      if(ip->addrs[EXTBLK] == 0)
+        break;
+      bp = bread(ip->dev, ip->addrs[EXTBLK]);
+      be = (struct extent*)bp->data;
+    }
+    x = i < NEXTENT ? &ie[i] : &be[i - NEXTENT];
+    if(x->len == 0)
+      break;
+    if(bn < x->len){
+      addr = x->start + bn;
+      goto out;
+    }
+    bn -= x->len;
+    last = x;
+  }
+
+  // bn is past the end of the file.
+  if(bn != 0)
+    goto out;
+  if(last && (addr = balloc_at(ip->dev, last->start + last->len)) != 0){
+    last->len++;
+    dirty = i - 1 >= NEXTENT;
+  } else if(i < NEXTENT + NEXTENTBLK){
+    if(i == NEXTENT && bp == 0){
+      if((ip->addrs[EXTBLK] = balloc(ip->dev)) == 0)
+        goto out;
+      bp = bread(ip->dev, ip->addrs[EXTBLK]);
+      x = (struct extent*)bp->data;
+    }
+    for(want = EXTRUN; (want < n || (last && want < 2*last->len)) && want < BPB; want *= 2)
+      ;
+    if(last)
+      goal = last->start + last->len;
+    else
+      goal = ip->inum % ((sb.size + BPB - 1) / BPB) * BPB;
+    if((addr = balloc_run(ip->dev, want, goal)) == 0)
+      goto out;
+    x->start = addr;
+    x->len = 1;
+    dirty = i >= NEXTENT;
+  }
+  if(dirty)
+    log_write(bp);  // changed an extent in the extent block
+out:
+  if(bp)
+    brelse(bp);
+  return addr;
+}
 
 // Return the disk block address of the nth block in inode ip.
 // If there is no such block, bmap allocates one.
@@ -385,6 +859,9 @@ bmap(struct inode *ip, uint bn)
   uint addr, *a;
   struct buf *bp;
 
+  if(ip->extents)
+    return bmap_extent(ip, bn, 1);
+
   if(bn < NDIRECT){
     if((addr = ip->addrs[bn]) == 0){
       addr = balloc(ip->dev);
@@ -456,60 +933,145 @@ bmap(struct inode *ip, uint bn)
   panic("bmap: out of range");
 }
 
-// Truncate inode (discard contents).
+// Return the data of ip's delayed block bn, which must
+// be at most one past the last, adding a zeroed one if
+// it is. returns 0 if there is no room for another.
 // Caller must hold ip->lock.
+static char*
+idelay(struct inode *ip, uint bn)
+{
+  int i = bn - ip->dstart;
+  char *data;
+
+  if(i < ip->ndelay)
+    return ip->delay[i];
+  if(i >= NDELAY || !fsum_reserve(1))
+    return 0;
+  if((data = kmem_cache_alloc(delaycache)) == 0){
+    fsum_reserve(-1);
+    return 0;
+  }
+  memset(data, 0, BSIZE);
+  ip->delay[ip->ndelay++] = data;
+  return data;
+}
+
+// Throw away ip's delayed blocks.
+// Caller must hold ip->lock.
+static void
+idiscard(struct inode *ip)
+{
+  for(int i = 0; i < ip->ndelay; i++)
+    kmem_cache_free(delaycache, ip->delay[i]);
+  fsum_reserve(-ip->ndelay);
+  ip->ndelay = 0;
+}
+
+// Allocate disk blocks for ip's delayed blocks, in one run
+// where there is room, and log their data. Called after a
+// write fills the delayed blocks, and when a writer closes
+// or fsyncs the file; starts its own transaction, so the
+// caller must not be in one or hold ip->lock.
 void
-itrunc(struct inode *ip)
+iflush(struct inode *ip)
 {
-  int i, j;
   struct buf *bp;
-  uint *a;
-
-  for(i = 0; i < NDIRECT; i++){
-    if(ip->addrs[i]){
-      bfree(ip->dev, ip->addrs[i]);
-      ip->addrs[i] = 0;
+  uint addr;
+  int i;
+
+  if(ip->ndelay == 0)
+    return;
+  begin_op(DELAYOPBLOCKS);
+  ilock(ip);
+  for(i = 0; i < ip->ndelay; i++){
+    if((addr = bmap_extent(ip, ip->dstart, ip->ndelay - i)) == 0){
+      // only if something else took the promised blocks.
+      printf("iflush: out of blocks\n");
+      ip->size = min(ip->size, ip->dstart*BSIZE);
+      break;
     }
+    bp = bread(ip->dev, addr);
+    memmove(bp->data, ip->delay[i], BSIZE);
+    if(ip->type == T_FILE)
+      log_write_data(bp);
+    else
+      log_write(bp);
+    brelse(bp);
+    ip->dstart++;
   }
-  for(i=0;i<NINDIRECT;i++){
-    if(ip->addrs[NDIRECT+i]){
-      bp = bread(ip->dev, ip->addrs[NDIRECT]);
-      a = (uint*)bp->data;
-      for(j = 0; j < NINDIRECT; j++){
-        if(a[j])
-          bfree(ip->dev, a[j]);
-      }
+  idiscard(ip);
+  iupdate(ip);
+  iunlock(ip);
+  end_op();
+}
+
+// Free the blocks listed in the n entries of a, and,
+// for depth > 0, the blocks they list in turn.
+static void
+bfree_table(uint dev, uint *a, int n, int depth)
+{
+  struct buf *bp;
+
+  for(int i = 0; i < n; i++){
+    if(a[i] == 0)
+      continue;
+    if(depth > 0){
+      bp = bread(dev, a[i]);
+      bfree_table(dev, (uint*)bp->data, NUMINDIRECT, depth - 1);
       brelse(bp);
-      bfree(ip->dev, ip->addrs[NDIRECT+i]);
-      ip->addrs[NDIRECT+i] = 0;
-    }
-  }
-  if(ip->addrs[NDIRECT+NINDIRECT]){
-    bp = bread(ip->dev, ip->addrs[NDIRECT]);
-      a = (uint*)bp->data;
-      for(j = 0; j < NINDIRECT; j++){
-        if(a[j]){
-          struct buf* bp1=bread(ip->dev,a[j]);
-          uint* b= (uint*)bp1->data;
-          for(i = 0; i < NINDIRECT; i++){
-            if(b[i]){
-              bfree(ip->dev,b[i]);
-            }
-          }
-          brelse(bp1);
-          bfree(ip->dev, a[j]);
-        }
-      }
+    }
+    bfree(dev, a[i]);
+  }
+}
+
+// Truncate inode (discard contents).
+// Caller must hold ip->lock.
+void
+itrunc(struct inode *ip)
+{
+  struct extent *x;
+  struct buf *bp;
+  int i;
+
+  if(ip->extents){
+    x = (struct extent*)ip->addrs;
+    for(i = 0; i < NEXTENT; i++)
+      bfree_run(ip->dev, x[i].start, x[i].len);
+    if(ip->addrs[EXTBLK]){
+      bp = bread(ip->dev, ip->addrs[EXTBLK]);
+      x = (struct extent*)bp->data;
+      for(i = 0; i < NEXTENTBLK; i++)
+        bfree_run(ip->dev, x[i].start, x[i].len);
       brelse(bp);
-      bfree(ip->dev, ip->addrs[NDIRECT+NINDIRECT]);
-      ip->addrs[NDIRECT+NINDIRECT] = 0;
+      bfree(ip->dev, ip->addrs[EXTBLK]);
+    }
+  } else {
+    bfree_table(ip->dev, ip->addrs, NDIRECT, 0);
+    bfree_table(ip->dev, ip->addrs + NDIRECT, NINDIRECT, 1);
+    bfree_table(ip->dev, ip->addrs + NDIRECT + NINDIRECT, NDINDIRECT, 2);
   }
+  memset(ip->addrs, 0, sizeof(ip->addrs));
+  idiscard(ip);
   ip->size = 0;
+  ip->dstart = 0;
   iupdate(ip);
 }
 
-// Copy stat information from inode.
+// Return the disk block holding block bn of ip, or 0 if
+// it has none: past the end of the file, or delayed.
 // Caller must hold ip->lock.
+uint
+ibmap(struct inode *ip, uint bn)
+{
+  if(bn >= (ip->size + BSIZE - 1) / BSIZE)
+    return 0;
+  if(ip->extents && bn >= ip->dstart)
+    return 0;
+  return bmap(ip, bn);
+}
+
+// Copy stat information from inode.
+// Caller must hold ip->lock, shared or exclusive.
 void
 stati(struct inode *ip, struct stat *st)
 {
@@ -520,8 +1082,26 @@ stati(struct inode *ip, struct stat *st)
   st->size = ip->size;
 }
 
-// Read data from inode.
+// Start reading n blocks of ip from block bn on into the
+// buffer cache, stopping at the end of the file.
 // Caller must hold ip->lock.
+void
+ireadahead(struct inode *ip, uint bn, uint n)
+{
+  uint nblocks = (ip->size + BSIZE - 1) / BSIZE;
+
+  if(ip->extents)
+    nblocks = min(nblocks, ip->dstart);
+  for(; n > 0 && bn < nblocks; bn++, n--){
+    uint addr = bmap(ip, bn);
+    if(addr == 0)
+      break;
+    breadahead(ip->dev, addr);
+  }
+}
+
+// Read data from inode.
+// Caller must hold ip->lock, shared or exclusive.
 // If user_dst==1, then dst is a user virtual address;
 // otherwise, dst is a kernel address.
 int
@@ -536,11 +1116,18 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
     n = ip->size - off;
 
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
+    m = min(n - tot, BSIZE - off%BSIZE);
+    if(ip->extents && off/BSIZE >= ip->dstart){
+      if(either_copyout(user_dst, dst, ip->delay[off/BSIZE - ip->dstart] + off%BSIZE, m) == -1){
+        tot = -1;
+        break;
+      }
+      continue;
+    }
     uint addr = bmap(ip, off/BSIZE);
     if(addr == 0)
       break;
     bp = bread(ip->dev, addr);
-    m = min(n - tot, BSIZE - off%BSIZE);
     if(either_copyout(user_dst, dst, bp->data + (off % BSIZE), m) == -1) {
       brelse(bp);
       tot = -1;
@@ -563,23 +1150,37 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
 {
   uint tot, m;
   struct buf *bp;
+  char *data;
+  int logged = 0;
 
   if(off > ip->size || off + n < off)
     return -1;
-  if(off + n > MAXFILE*BSIZE)
+  if(!ip->extents && off + n > MAXFILE*BSIZE)
     return -1;
 
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
+    m = min(n - tot, BSIZE - off%BSIZE);
+    if(ip->extents && off/BSIZE >= ip->dstart){
+      // no disk block until iflush().
+      if((data = idelay(ip, off/BSIZE)) == 0)
+        break;
+      if(either_copyin(data + (off % BSIZE), user_src, src, m) == -1)
+        break;
+      continue;
+    }
     uint addr = bmap(ip, off/BSIZE);
     if(addr == 0)
       break;
     bp = bread(ip->dev, addr);
-    m = min(n - tot, BSIZE - off%BSIZE);
+    logged = 1;
     if(either_copyin(bp->data + (off % BSIZE), user_src, src, m) == -1) {
       brelse(bp);
       break;
     }
-    log_write(bp);
+    if(ip->type == T_FILE)
+      log_write_data(bp);
+    else
+      log_write(bp);  // directories and symlinks are metadata
     brelse(bp);
   }
 
@@ -588,8 +1189,10 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
 
   // write the i-node back to disk even if the size didn't change
   // because the loop above might have called bmap() and added a new
-  // block to ip->addrs[].
-  iupdate(ip);
+  // block to ip->addrs[]. a write only to delayed blocks changes
+  // nothing on disk.
+  if(logged)
+    iupdate(ip);
 
   return tot;
 }
@@ -602,42 +1205,380 @@ namecmp(const char *s, const char *t)
   return strncmp(s, t, DIRSIZ);
 }
 
+// Name cache.
+//
+// Remembers the results of recent directory lookups, keyed
+// by (dev, directory i-number, name), including names that
+// were not there (negative entries, with inum 0), so that
+// namex() can walk a cached path without locking or reading
+// the directories on it. dirlink() and dirunlink() keep the
+// entries of a directory up to date while holding its lock;
+// when a directory's inode is freed, its entries go.
+// Entries are replaced with the clock algorithm.
+
+#define NDHASH 61
+
+struct dentry {
+  uint dev;
+  uint parent;          // i-number of the directory; 0 if unused
+  uint inum;            // 0 if name is not in the directory
+  char name[DIRSIZ];
+  int used;             // looked up since the clock hand passed
+  struct dentry *next;  // hash chain
+};
+
+struct {
+  struct spinlock lock;
+  struct dentry ent[NDCACHE];
+  struct dentry *bucket[NDHASH];
+  int hand;
+  uint64 hits;          // lookups answered, with an inode
+  uint64 neghits;       // lookups answered, with no such name
+  uint64 misses;
+} dcache;
+
+static void
+dcache_init(void)
+{
+  initlock(&dcache.lock, "dcache");
+}
+
+static struct dentry**
+dhash(uint dev, uint parent, char *name)
+{
+  return &dcache.bucket[(dirhash(name) ^ parent ^ dev) % NDHASH];
+}
+
+// Caller must hold dcache.lock.
+static struct dentry*
+dfind(uint dev, uint parent, char *name)
+{
+  struct dentry *d;
+
+  for(d = *dhash(dev, parent, name); d; d = d->next)
+    if(d->dev == dev && d->parent == parent && namecmp(d->name, name) == 0)
+      return d;
+  return 0;
+}
+
+// Caller must hold dcache.lock.
+static void
+dunhash(struct dentry *d)
+{
+  struct dentry **pp;
+
+  for(pp = dhash(d->dev, d->parent, d->name); *pp != d; pp = &(*pp)->next)
+    ;
+  *pp = d->next;
+  d->parent = 0;
+}
+
+// Look up name in directory (dev, parent) in the cache. On a
+// hit, set *ipp to the inode, or to 0 if the name isn't there,
+// and return 1; return 0 on a miss. The reference is taken
+// under dcache.lock, so the inode can't be unlinked and freed
+// in between.
+static int
+dcache_get(uint dev, uint parent, char *name, struct inode **ipp)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  if((d = dfind(dev, parent, name)) == 0){
+    dcache.misses++;
+    release(&dcache.lock);
+    return 0;
+  }
+  d->used = 1;
+  if(d->inum){
+    dcache.hits++;
+    *ipp = iget(dev, d->inum);
+  } else {
+    dcache.neghits++;
+    *ipp = 0;
+  }
+  release(&dcache.lock);
+  return 1;
+}
+
+// Record that name in directory dp is inum, or, if inum
+// is 0, that it isn't there. Caller must hold dp->lock.
+static void
+dcache_enter(struct inode *dp, char *name, uint inum)
+{
+  struct dentry *d, **pp;
+
+  acquire(&dcache.lock);
+  if((d = dfind(dp->dev, dp->inum, name)) == 0){
+    for(;;){
+      d = &dcache.ent[dcache.hand];
+      dcache.hand = (dcache.hand + 1) % NDCACHE;
+      if(d->parent == 0 || !d->used)
+        break;
+      d->used = 0;
+    }
+    if(d->parent)
+      dunhash(d);
+    d->dev = dp->dev;
+    d->parent = dp->inum;
+    strncpy(d->name, name, DIRSIZ);
+    pp = dhash(d->dev, d->parent, d->name);
+    d->next = *pp;
+    *pp = d;
+  }
+  d->inum = inum;
+  d->used = 1;
+  release(&dcache.lock);
+}
+
+// Forget the entries of directory inum, whose inode is
+// being freed.
+static void
+dcache_purge(uint dev, uint inum)
+{
+  acquire(&dcache.lock);
+  for(int i = 0; i < NDCACHE; i++)
+    if(dcache.ent[i].parent == inum && dcache.ent[i].dev == dev)
+      dunhash(&dcache.ent[i]);
+  release(&dcache.lock);
+}
+
+// Print name cache counters into buf.
+int
+statsdcache(char *buf, int sz)
+{
+  uint64 total;
+  int n;
+
+  acquire(&dcache.lock);
+  total = dcache.hits + dcache.neghits + dcache.misses;
+  n = snprintf(buf, sz, "--- name cache\n"
+               "dcache: lookups %d hits %d negative hits %d misses %d hit rate %d%%\n",
+               (int)total, (int)dcache.hits, (int)dcache.neghits, (int)dcache.misses,
+               total ? (int)((dcache.hits + dcache.neghits) * 100 / total) : 0);
+  release(&dcache.lock);
+  return n;
+}
+
+// Look for name in block bn of directory dp. If found,
+// return its i-number and set *poff to the byte offset
+// of the entry; otherwise return 0.
+static uint
+dirscan(struct inode *dp, uint bn, char *name, uint *poff)
+{
+  struct buf *bp;
+  struct dirent *de;
+  uint inum = 0;
+
+  bp = bread(dp->dev, bmap(dp, bn));
+  for(de = (struct dirent*)bp->data; de < (struct dirent*)(bp->data + BSIZE); de++){
+    if(de->inum != 0 && namecmp(name, de->name) == 0){
+      inum = de->inum;
+      if(poff)
+        *poff = bn*BSIZE + (de - (struct dirent*)bp->data)*sizeof(*de);
+      break;
+    }
+  }
+  brelse(bp);
+  return inum;
+}
+
+// Hashed directories.
+//
+// A linear directory is converted when a new entry doesn't
+// fit in its first block. Each block of entries is pointed
+// to by the table entries whose indexes agree in their low
+// bits, as many bits as it takes to pick out DIRTAB / (number
+// of table entries pointing at it). When a block fills up it
+// is split on the next bit: the entries with that bit of
+// their hash set move to a new block, and so do half of its
+// table entries. Entries are never merged back.
+
+// Return a pointer to entry i of the table in tb[].
+static ushort*
+dirtab(struct buf **tb, int i)
+{
+  struct dirent *de = (struct dirent*)tb[i / DIRTABPB]->data + i % DIRTABPB / 7;
+
+  return (ushort*)de->name + i % 7;
+}
+
+static void
+dirtab_read(struct inode *dp, struct buf **tb)
+{
+  tb[0] = bread(dp->dev, bmap(dp, 1));
+  tb[1] = bread(dp->dev, bmap(dp, 2));
+}
+
+static void
+dirtab_release(struct buf **tb)
+{
+  brelse(tb[0]);
+  brelse(tb[1]);
+}
+
+// Return the block of hashed directory dp that has the
+// entry for name, if there is one.
+static uint
+dirblock(struct inode *dp, char *name)
+{
+  struct buf *tb[2];
+  uint bn;
+
+  dirtab_read(dp, tb);
+  bn = *dirtab(tb, dirhash(name) % DIRTAB);
+  dirtab_release(tb);
+  return bn;
+}
+
+// Append a zeroed block to directory dp; return its number
+// within dp, or 0 if out of disk space.
+static uint
+dirgrow(struct inode *dp)
+{
+  uint bn = dp->size / BSIZE;
+
+  if(bn >= MAXFILE || bmap(dp, bn) == 0)
+    return 0;
+  dp->size += BSIZE;
+  return bn;
+}
+
+// Convert linear directory dp, whose one block is full, to
+// a hashed directory: its entries other than "." and ".."
+// move into two new blocks. returns -1 if out of disk space.
+static int
+dirconvert(struct inode *dp)
+{
+  struct buf *bp, *tb[2], *nb[2];
+  struct dirent *de, *ne[2];
+  int i;
+
+  if(dp->size != BSIZE)
+    panic("dirconvert");
+  for(i = 1; i < DIRBUCKET + 2; i++){
+    if(dirgrow(dp) == 0){
+      // stay linear; itrunc() will free the new blocks.
+      dp->size = BSIZE;
+      iupdate(dp);
+      return -1;
+    }
+  }
+  dirtab_read(dp, tb);
+  for(i = 0; i < DIRTAB; i++)
+    *dirtab(tb, i) = DIRBUCKET + i % 2;
+  log_write(tb[0]);
+  log_write(tb[1]);
+  dirtab_release(tb);
+
+  bp = bread(dp->dev, bmap(dp, 0));
+  for(i = 0; i < 2; i++){
+    nb[i] = bread(dp->dev, bmap(dp, DIRBUCKET + i));
+    ne[i] = (struct dirent*)nb[i]->data;
+  }
+  for(de = (struct dirent*)bp->data + 2; de < (struct dirent*)(bp->data + BSIZE); de++){
+    if(de->inum == 0)
+      continue;
+    i = dirhash(de->name) % 2;
+    *ne[i]++ = *de;
+    memset(de, 0, sizeof(*de));
+  }
+  for(i = 0; i < 2; i++){
+    log_write(nb[i]);
+    brelse(nb[i]);
+  }
+  log_write(bp);
+  brelse(bp);
+
+  dp->hashed = 1;
+  iupdate(dp);
+  return 0;
+}
+
+// Split the block of hashed directory dp that table entry
+// t points to. returns -1 if it can't be split, or if out
+// of disk space.
+static int
+dirsplit(struct inode *dp, int t)
+{
+  struct buf *tb[2], *bp, *np;
+  struct dirent *de, *ne;
+  uint bn, nbn;
+  int i, n, bit;
+
+  dirtab_read(dp, tb);
+  bn = *dirtab(tb, t);
+  n = 0;
+  for(i = 0; i < DIRTAB; i++)
+    if(*dirtab(tb, i) == bn)
+      n++;
+  // the entries pointing at bn agree in the bits below bit.
+  bit = DIRTAB / n;
+  if(n == 1 || (nbn = dirgrow(dp)) == 0){
+    dirtab_release(tb);
+    return -1;
+  }
+  for(i = 0; i < DIRTAB; i++)
+    if(*dirtab(tb, i) == bn && (i & bit))
+      *dirtab(tb, i) = nbn;
+  log_write(tb[0]);
+  log_write(tb[1]);
+  dirtab_release(tb);
+
+  bp = bread(dp->dev, bmap(dp, bn));
+  np = bread(dp->dev, bmap(dp, nbn));
+  ne = (struct dirent*)np->data;
+  for(de = (struct dirent*)bp->data; de < (struct dirent*)(bp->data + BSIZE); de++){
+    if(de->inum != 0 && (dirhash(de->name) & bit)){
+      *ne++ = *de;
+      memset(de, 0, sizeof(*de));
+    }
+  }
+  log_write(np);
+  brelse(np);
+  log_write(bp);
+  brelse(bp);
+  iupdate(dp);
+  return 0;
+}
+
 // Look for a directory entry in a directory.
 // If found, set *poff to byte offset of entry.
+// Caller must hold dp->lock, shared or exclusive.
 struct inode*
 dirlookup(struct inode *dp, char *name, uint *poff)
 {
-  uint off, inum;
-  struct dirent de;
+  uint bn, inum = 0;
+  struct inode *ip;
 
   if(dp->type != T_DIR)
     panic("dirlookup not DIR");
 
-  for(off = 0; off < dp->size; off += sizeof(de)){
-    if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-      panic("dirlookup read");
-    if(de.inum == 0)
-      continue;
-    if(namecmp(name, de.name) == 0){
-      // entry matches path element
-      if(poff)
-        *poff = off;
-      inum = de.inum;
-      return iget(dp->dev, inum);
-    }
+  if(poff == 0 && dcache_get(dp->dev, dp->inum, name, &ip))
+    return ip;
+  if(dp->hashed && namecmp(name, ".") != 0 && namecmp(name, "..") != 0){
+    inum = dirscan(dp, dirblock(dp, name), name, poff);
+  } else {
+    // "." and ".." are always in block 0.
+    for(bn = 0; bn < (dp->hashed ? 1 : dp->size / BSIZE) && inum == 0; bn++)
+      inum = dirscan(dp, bn, name, poff);
   }
-
-  return 0;
+  dcache_enter(dp, name, inum);
+  if(inum == 0)
+    return 0;
+  return iget(dp->dev, inum);
 }
 
 // Write a new directory entry (name, inum) into the directory dp.
 // Returns 0 on success, -1 on failure (e.g. out of disk blocks).
+// The caller's op must have reserved DIROPBLOCKS.
 int
 dirlink(struct inode *dp, char *name, uint inum)
 {
-  int off;
-  struct dirent de;
+  int off, t, nsplit;
+  struct dirent de, *e;
   struct inode *ip;
+  struct buf *bp;
 
   // Check that name is not present.
   if((ip = dirlookup(dp, name, 0)) != 0){
@@ -645,19 +1586,62 @@ dirlink(struct inode *dp, char *name, uint inum)
     return -1;
   }
 
-  // Look for an empty dirent.
-  for(off = 0; off < dp->size; off += sizeof(de)){
-    if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-      panic("dirlink read");
-    if(de.inum == 0)
-      break;
+  if(!dp->hashed){
+    // Look for an empty dirent.
+    for(off = 0; off < dp->size; off += sizeof(de)){
+      if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+        panic("dirlink read");
+      if(de.inum == 0)
+        break;
+    }
+    // a directory made by an older kernel may be linear
+    // and bigger than one block.
+    if(off < dp->size || dp->size != BSIZE){
+      strncpy(de.name, name, DIRSIZ);
+      de.inum = inum;
+      if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+        return -1;
+      dcache_enter(dp, name, inum);
+      return 0;
+    }
+    if(dirconvert(dp) < 0)
+      return -1;
+  }
+
+  // find room in the entry's block, splitting it if full.
+  // the op reserved room for DIRSPLITS splits (DIROPBLOCKS):
+  // if the block is still full after that many, give up; the
+  // splits are kept, and a later link can split it further.
+  t = dirhash(name) % DIRTAB;
+  for(nsplit = 0; ; nsplit++){
+    bp = bread(dp->dev, bmap(dp, dirblock(dp, name)));
+    for(e = (struct dirent*)bp->data; e < (struct dirent*)(bp->data + BSIZE); e++){
+      if(e->inum == 0){
+        strncpy(e->name, name, DIRSIZ);
+        e->inum = inum;
+        log_write(bp);
+        brelse(bp);
+        dcache_enter(dp, name, inum);
+        return 0;
+      }
+    }
+    brelse(bp);
+    if(nsplit == DIRSPLITS || dirsplit(dp, t) < 0)
+      return -1;
   }
+}
+
+// Remove the entry for name, at byte offset off, from
+// directory dp. Returns 0 on success, -1 on failure.
+int
+dirunlink(struct inode *dp, char *name, uint off)
+{
+  struct dirent de;
 
-  strncpy(de.name, name, DIRSIZ);
-  de.inum = inum;
+  memset(&de, 0, sizeof(de));
   if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
     return -1;
-
+  dcache_enter(dp, name, 0);
   return 0;
 }
 
@@ -715,7 +1699,17 @@ namex(char *path, int nameiparent, char *name)
     ip = idup(myproc()->cwd);
 
   while((path = skipelem(path, name)) != 0){
-    ilock(ip);
+    // try the name cache without locking ip. the type of a
+    // valid inode can't change while we hold a reference.
+    if(ip->valid && ip->type == T_DIR && !(nameiparent && *path == '\0') &&
+       dcache_get(ip->dev, ip->inum, name, &next)){
+      iput(ip);
+      if(next == 0)
+        return 0;
+      ip = next;
+      continue;
+    }
+    ilock_shared(ip);
     if(ip->type != T_DIR){
       iunlockput(ip);
       return 0;
@@ -20,10 +20,13 @@ struct superblock {
   uint logstart;     // Block number of first log block
   uint inodestart;   // Block number of first inode block
   uint bmapstart;    // Block number of first free map block
+  uint flags;        // SB_ flags, below
 };
 
 #define FSMAGIC 0x10203040
 
+#define SB_ORDERED 0x1   // log metadata only; file data goes straight home
+
 #define NDIRECT 9
 #define NINDIRECT 3
 #define NDINDIRECT 1
@@ -31,14 +34,31 @@ struct superblock {
 #define NUMDINDIRECT (NUMINDIRECT * NUMINDIRECT)
 #define MAXFILE (NDIRECT + NINDIRECT * NUMINDIRECT + NDINDIRECT * NUMDINDIRECT)
 
+// An extent maps len consecutive blocks of a file to the disk
+// blocks from start on. A file's extents map its blocks in order.
+struct extent {
+  uint start;
+  uint len;
+};
+
+#define NEXTENT 6           // extents in the inode, in addrs[0..11]
+#define EXTBLK (2*NEXTENT)  // addrs[] index of the block of more extents
+#define NEXTENTBLK (BSIZE / sizeof(struct extent))
+
+// dinode.type holds the file type in its low byte and
+// flags in its high byte.
+#define DI_EXTENTS 0x100    // addrs[] holds extents, not block numbers
+#define DI_HASHED  0x200    // directory with a hash index
+#define DI_TYPE(t) ((t) & 0xff)
+
 // On-disk inode structure
 struct dinode {
-  short type;           // File type
+  short type;           // File type and flags
   short major;          // Major device number (T_DEVICE only)
   short minor;          // Minor device number (T_DEVICE only)
   short nlink;          // Number of links to inode in file system
   uint size;            // Size of file (bytes)
-  uint addrs[NDIRECT + NINDIRECT + NDINDIRECT];   // Data block addresses
+  uint addrs[NDIRECT + NINDIRECT + NDINDIRECT];   // Data block addresses, or extents
 };
 
 // Inodes per block.
@@ -61,3 +81,24 @@ struct dirent {
   char name[DIRSIZ];
 };
 
+// A directory that outgrows one block is hashed. Block 0
+// holds "." and "..". Blocks 1 and 2 hold a table of DIRTAB
+// block numbers, indexed by the low bits of dirhash(name),
+// giving the block that holds the entry; more than one table
+// entry may share a block. The table sits in the names of
+// dirents with inum 0, 7 to a dirent, so a hashed directory
+// still reads as a sequence of dirents.
+#define DIRTAB 512
+#define DIRTABPB (7 * (BSIZE / sizeof(struct dirent)))  // table entries per block
+#define DIRBUCKET 3   // first block of entries
+
+static inline uint
+dirhash(const char *name)
+{
+  uint h = 2166136261U;
+
+  for(int i = 0; i < DIRSIZ && name[i]; i++)
+    h = (h ^ (uchar)name[i]) * 16777619;
+  return h;
+}
+
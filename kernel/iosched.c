@@ -0,0 +1,249 @@
+//
+// I/O scheduler: sits between the buffer cache and the disk
+// driver. Bufs submitted by bio.c wait in a queue; whenever the
+// driver has room, a policy picks the next buf to send, and
+// queued bufs for the following consecutive blocks in the same
+// direction are merged into the same multi-block request.
+//
+// Policies:
+// * noop: first come, first served.
+// * elevator: one-way (C-SCAN) sweep by block number, except
+//   that a buf queued for more than DEADLINE ticks goes first.
+//
+// Interface:
+// * iosched_submit(b, write, done) queues locked buf b.
+// * iosched_submitv(bs, n, write) queues several at once, so
+//   that they can be merged before any is sent.
+// * iosched_trysubmit(b, write, done) queues b unless the queue
+//   is full, for requests that can be dropped.
+// * when b's transfer is done, done(b) is called from the disk
+//   interrupt if done is set; otherwise iosched_wait(b) returns.
+//
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "riscv.h"
+#include "defs.h"
+#include "fs.h"
+#include "buf.h"
+#include "virtio.h"
+
+#define DEADLINE 10   // ticks a queued buf may be passed over
+#define TRYDEPTH 64   // queued bufs at which iosched_trysubmit() refuses
+
+struct iopolicy {
+  char *name;
+  // pick the buf to send next; it stays on the queue.
+  struct buf *(*next)(void);
+};
+
+static struct buf *noop_next(void);
+static struct buf *elevator_next(void);
+
+static struct iopolicy policies[] = {
+  { "noop", noop_next },
+  { "elevator", elevator_next },
+};
+
+struct {
+  struct spinlock lock;
+  struct iopolicy *policy;
+  struct buf *head;       // queued bufs, oldest first, through qnext
+  struct buf *tail;
+  uint pos;               // block after the last one sent
+
+  // statistics.
+  int depth;              // bufs queued now
+  int maxdepth;
+  int inflight;           // bufs sent and not yet done
+  uint64 nreq;            // requests sent to the driver
+  uint64 nbuf;            // bufs in those requests
+} ios;
+
+extern uint ticks;
+
+void
+iosched_init(void)
+{
+  initlock(&ios.lock, "iosched");
+  ios.policy = &policies[0];
+  for(int i = 0; i < NELEM(policies); i++)
+    if(strncmp(policies[i].name, IOSCHED, 16) == 0)
+      ios.policy = &policies[i];
+}
+
+static struct buf*
+noop_next(void)
+{
+  return ios.head;
+}
+
+static struct buf*
+elevator_next(void)
+{
+  struct buf *b, *best = 0, *lowest = 0;
+
+  if(ios.head && ticks - ios.head->qtick > DEADLINE)
+    return ios.head;
+  for(b = ios.head; b; b = b->qnext){
+    if(b->blockno >= ios.pos && (best == 0 || b->blockno < best->blockno))
+      best = b;
+    if(lowest == 0 || b->blockno < lowest->blockno)
+      lowest = b;
+  }
+  // nothing ahead of the head position: wrap around.
+  return best ? best : lowest;
+}
+
+static void
+unqueue(struct buf *b)
+{
+  struct buf **pp, *prev = 0;
+
+  for(pp = &ios.head; *pp != b; pp = &(*pp)->qnext)
+    prev = *pp;
+  *pp = b->qnext;
+  if(ios.tail == b)
+    ios.tail = prev;
+  ios.depth--;
+}
+
+static void iosched_done(struct buf *);
+
+// send queued bufs to the driver until the queue is
+// empty or the driver is full.
+// caller must hold ios.lock.
+static void
+dispatch(void)
+{
+  struct buf *bs[NSEG];
+  struct buf *b;
+  int n;
+
+  while((b = ios.policy->next()) != 0){
+    // gather queued bufs for the blocks that follow.
+    bs[0] = b;
+    for(n = 1; n < NSEG; n++){
+      for(b = ios.head; b; b = b->qnext)
+        if(b->dev == bs[0]->dev && b->qwrite == bs[0]->qwrite &&
+           b->blockno == bs[n-1]->blockno + 1)
+          break;
+      if(b == 0)
+        break;
+      bs[n] = b;
+    }
+    if((n = virtio_disk_trysubmitv(bs, n, bs[0]->qwrite, iosched_done)) < 0)
+      return;  // iosched_done() will try again
+    for(int i = 0; i < n; i++)
+      unqueue(bs[i]);
+    ios.pos = bs[n-1]->blockno + 1;
+    ios.inflight += n;
+    ios.nreq++;
+    ios.nbuf += n;
+  }
+}
+
+// called by the disk interrupt handler when the driver
+// is done with b.
+static void
+iosched_done(struct buf *b)
+{
+  void (*done)(struct buf *);
+
+  acquire(&ios.lock);
+  done = b->iodone;
+  b->qbusy = 0;
+  ios.inflight--;
+  dispatch();
+  if(done == 0)
+    wakeup(b);
+  release(&ios.lock);
+  if(done)
+    done(b);
+}
+
+// caller must hold ios.lock.
+static void
+enqueue(struct buf *b, int write, void (*done)(struct buf *))
+{
+  b->qbusy = 1;
+  b->qwrite = write;
+  b->iodone = done;
+  b->qtick = ticks;
+  b->qnext = 0;
+  if(ios.tail)
+    ios.tail->qnext = b;
+  else
+    ios.head = b;
+  ios.tail = b;
+  if(++ios.depth > ios.maxdepth)
+    ios.maxdepth = ios.depth;
+}
+
+void
+iosched_submit(struct buf *b, int write, void (*done)(struct buf *))
+{
+  acquire(&ios.lock);
+  enqueue(b, write, done);
+  dispatch();
+  release(&ios.lock);
+}
+
+void
+iosched_submitv(struct buf **bs, int n, int write)
+{
+  acquire(&ios.lock);
+  for(int i = 0; i < n; i++)
+    enqueue(bs[i], write, 0);
+  dispatch();
+  release(&ios.lock);
+}
+
+// like iosched_submit(), for requests that may be dropped,
+// such as read-ahead: if the queue is already TRYDEPTH deep,
+// queue nothing and return -1.
+int
+iosched_trysubmit(struct buf *b, int write, void (*done)(struct buf *))
+{
+  acquire(&ios.lock);
+  if(ios.depth >= TRYDEPTH){
+    release(&ios.lock);
+    return -1;
+  }
+  enqueue(b, write, done);
+  dispatch();
+  release(&ios.lock);
+  return 0;
+}
+
+// wait for a buf submitted without a callback.
+void
+iosched_wait(struct buf *b)
+{
+  acquire(&ios.lock);
+  while(b->qbusy)
+    sleep(b, &ios.lock);
+  release(&ios.lock);
+}
+
+// Print queue statistics into buf. the merge rate is the
+// average number of bufs per request, in hundredths.
+int
+statsiosched(char *buf, int sz)
+{
+  int n;
+
+  acquire(&ios.lock);
+  n = snprintf(buf, sz, "--- io scheduler\n"
+               "iosched: %s: depth %d max %d inflight %d requests %d bufs %d "
+               "bufs/request %d.%d%d\n",
+               ios.policy->name, ios.depth, ios.maxdepth, ios.inflight,
+               (int)ios.nreq, (int)ios.nbuf,
+               ios.nreq ? (int)(ios.nbuf / ios.nreq) : 0,
+               ios.nreq ? (int)(ios.nbuf * 10 / ios.nreq % 10) : 0,
+               ios.nreq ? (int)(ios.nbuf * 100 / ios.nreq % 10) : 0);
+  release(&ios.lock);
+  return n;
+}
@@ -1,6 +1,30 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
-// and pipe buffers. Allocates whole 4096-byte pages.
+// and pipe buffers. Allocates whole 4096-byte pages,
+// or physically contiguous blocks of 2^order pages.
+//
+// Free pages live in two tiers: a small per-CPU cache that
+// kalloc()/kfree() use without touching any shared lock, and
+// the global kmem pool that the caches refill from and drain
+// into KBATCH pages at a time.
+//
+// The global pool is a binary buddy allocator. A free block of
+// order k is 2^k pages whose first page frame number is a
+// multiple of 2^k; its buddy is the block whose frame number
+// differs only in bit k. Freeing a block merges it with its
+// buddy for as long as the buddy is free and of the same order.
+//
+// Memory is not handed to the pool page by page at boot.
+// kinit() just records the untouched range [kmem.lazy,
+// kmem.lazyend), and buddy_alloc() carves the next block of up
+// to 2^MAXORDER pages off it whenever the free lists run dry.
+//
+// Freed pages are not cleared. When a CPU has nothing to run,
+// the scheduler calls kzeroidle(), which moves pages from the
+// buddy pool into a pool of pre-zeroed pages that
+// kalloc_zeroed() serves from. Build with KJUNK defined to fill
+// pages with junk on kfree()/kalloc() to catch dangling refs,
+// and to check the buddy allocator at boot.
 
 #include "types.h"
 #include "param.h"
@@ -9,8 +33,21 @@
 #include "riscv.h"
 #include "defs.h"
 
+// pages moved between a CPU cache and the global pool at once.
+#define KBATCH 32
+// a CPU cache holding more than this many pages drains a batch.
+#define KCACHEMAX (4*KBATCH)
+// pages the idle loop keeps pre-zeroed.
+#define KZEROMAX 1024
+// pages zeroed per call to kzeroidle().
+#define KZEROBATCH 8
+
+#ifdef KJUNK
+#define kjunk(pa, c, n) memset((pa), (c), (n))
+#else
+#define kjunk(pa, c, n)
+#endif
 
-void freerange(void *pa_start, void *pa_end);
 void initfreecnt();
 void initref();
 extern char end[];  // first address after kernel.
@@ -18,36 +55,154 @@ extern char end[];  // first address after kernel.
 
 struct run {
   struct run *next;
+  struct run *prev;       // buddy free lists only
 };
 
+// global pool of free pages.
 struct {
   struct spinlock lock;
-  struct run *freelist;
-  uint64 freememcnt;
-  int refv[PHYPAGENUM];
+  struct run *freelist[MAXORDER+1];  // free blocks of each order
+  uint64 freememcnt;      // includes the untouched range
+  int lazy;               // first page of the untouched range
+  int lazyend;            // end of the untouched range
 } kmem;
 
+// free pages that have already been zeroed, apart from
+// the run link in their first word.
+struct {
+  struct spinlock lock;
+  struct run *freelist;
+  int n;
+} kzero;
+
+// for each page frame: order+1 if it heads a free block
+// in kmem.freelist, 0 otherwise. protected by kmem.lock.
+static uchar pgorder[PHYPAGENUM];
+
+// per-CPU page cache. kc->lock is only ever contended
+// when another CPU runs dry and steals a page.
+struct kcache {
+  struct spinlock lock;
+  struct run *freelist;
+  int n;                  // pages on freelist
+  struct kmemstat stat;
+} kcache[NCPU];
+
+// physical page reference counts, indexed by kpgindex().
+// updated with atomic amoadd so that sharing and unsharing COW
+// pages never takes a lock; only the drop to zero touches a
+// free list.
+static int refv[PHYPAGENUM];
+
+// page frame number of pa, or -1 if pa is not an
+// allocatable page.
 static inline int kpgindex(void* pa){
   if(((uint64)pa % PGSIZE) != 0 || (uint64)pa < PGROUNDUP((uint64)end) || (uint64)pa >= PHYSTOP){
     return -1;
   }
-  return ((uint64)pa-PGROUNDUP((uint64)end))>>PGSHIFT;
+  return ((uint64)pa-KERNBASE)>>PGSHIFT;
+}
+static inline void *kpgaddr(int idx){
+  return (void *)(KERNBASE + ((uint64)idx << PGSHIFT));
 }
 void kinit() {
   initlock(&kmem.lock, "kmem");
+  initlock(&kzero.lock, "kzero");
+  for(int i = 0; i < NCPU; i++)
+    initlock(&kcache[i].lock, "kmem_cpu");
   initfreecnt();
   initref();
-  freerange(end, (void *)PHYSTOP);
+  kmem.lazy = kpgindex((void *)PGROUNDUP((uint64)end));
+  kmem.lazyend = PHYPAGENUM;
+  kmem.freememcnt = (uint64)(kmem.lazyend - kmem.lazy) * PGSIZE;
 }
 void initref(){
-  memset(kmem.refv,0,NELEM(kmem.refv));
+  memset(refv,0,sizeof(refv));
+  memset(pgorder,0,sizeof(pgorder));
 }
 void initfreecnt() { kmem.freememcnt = 0; }
-void freerange(void *pa_start, void *pa_end) {
-  char *p;
-  p = (char *)PGROUNDUP((uint64)pa_start);
-  for (; p + PGSIZE <= (char *)pa_end; p += PGSIZE) kmeminit(p);
+
+// push the block at idx onto the order list.
+// caller must hold kmem.lock.
+static void buddy_link(int idx, int order) {
+  struct run *r = (struct run *)kpgaddr(idx);
+
+  r->prev = 0;
+  r->next = kmem.freelist[order];
+  if(r->next)
+    r->next->prev = r;
+  kmem.freelist[order] = r;
+  pgorder[idx] = order + 1;
 }
+// unlink the free block at idx from the order list.
+// caller must hold kmem.lock.
+static void buddy_unlink(int idx, int order) {
+  struct run *r = (struct run *)kpgaddr(idx);
+
+  if(r->prev)
+    r->prev->next = r->next;
+  else
+    kmem.freelist[order] = r->next;
+  if(r->next)
+    r->next->prev = r->prev;
+  pgorder[idx] = 0;
+}
+// return the block of 2^order pages at idx to the pool,
+// merging it with its buddies.
+// caller must hold kmem.lock.
+static void buddy_free(int idx, int order) {
+  kmem.freememcnt += (uint64)PGSIZE << order;
+  while(order < MAXORDER){
+    int buddy = idx ^ (1 << order);
+    if(buddy >= PHYPAGENUM || pgorder[buddy] != order + 1)
+      break;
+    buddy_unlink(buddy, order);
+    idx &= ~(1 << order);
+    order++;
+  }
+  buddy_link(idx, order);
+}
+// move the largest aligned block at the start of the untouched
+// range into the free lists. returns 0 if the range is used up.
+// caller must hold kmem.lock.
+static int buddy_carve(void) {
+  int idx = kmem.lazy;
+  int o;
+
+  if(idx >= kmem.lazyend)
+    return 0;
+  for(o = MAXORDER; (idx & ((1 << o) - 1)) != 0 || idx + (1 << o) > kmem.lazyend; o--)
+    ;
+  kmem.lazy += 1 << o;
+  kmem.freememcnt -= (uint64)PGSIZE << o;  // buddy_free() adds it back
+  buddy_free(idx, o);
+  return 1;
+}
+// take a block of 2^order pages from the pool, splitting
+// a larger block if needed. returns its index, or -1.
+// caller must hold kmem.lock.
+static int buddy_alloc(int order) {
+  int o, idx;
+
+  for(;;){
+    for(o = order; o <= MAXORDER && kmem.freelist[o] == 0; o++)
+      ;
+    if(o <= MAXORDER)
+      break;
+    if(!buddy_carve())
+      return -1;
+  }
+  idx = kpgindex(kmem.freelist[o]);
+  buddy_unlink(idx, o);
+  // give back the upper halves we don't need.
+  while(o > order){
+    o--;
+    buddy_link(idx + (1 << o), o);
+  }
+  kmem.freememcnt -= (uint64)PGSIZE << order;
+  return idx;
+}
+
 // increase the ref counter of the physics page contains pa.
 // @return the page base addr.
 void* kgetpage(void* pa) {
@@ -55,52 +210,142 @@ void* kgetpage(void* pa) {
   int idx = kpgindex(addr);
   if (idx < 0)
     panic("kgetpage");
-  acquire(&kmem.lock);
-  if(kmem.refv[idx] <= 0){
+  if(__sync_fetch_and_add(&refv[idx], 1) <= 0){
     panic("kgetpage illegal ref");
   }
-  kmem.refv[idx]++;
-  release(&kmem.lock);
   return addr;
 }
+// return the number of references to the page containing pa.
+// only stable if the caller holds the sole reference.
+int kgetref(void* pa) {
+  int idx = kpgindex((void*)PGROUNDDOWN((uint64)pa));
+  if (idx < 0)
+    panic("kgetref");
+  return lockfree_read4(&refv[idx]);
+}
+// drop one reference to page idx.
+// returns 1 if that was the last one.
+static int kputref(int idx) {
+  int ref = __sync_sub_and_fetch(&refv[idx], 1);
+  if(ref < 0){
+    panic("kfree illegal ref");
+  }
+  return ref == 0;
+}
 // 1. decrease ref counter of the page of physical memory pointed at by pa,
 // which normally should have been returned by a call to kalloc().
-// 2. free the page if no refs.
+// 2. free the page into this CPU's cache if no refs.
 void kfree(void* pa) {
   int idx = kpgindex(pa);
   if (idx < 0)
     panic("kputpage");
-  acquire(&kmem.lock);
-  if(kmem.refv[idx] < 0){
-    panic("kfree illegal ref");
+  if(!kputref(idx))
+    return;
+
+  // Fill with junk to catch dangling refs.
+  kjunk(pa, 1, PGSIZE);
+
+  push_off();
+  struct kcache *kc = &kcache[cpuid()];
+  struct run *r = (struct run *)pa;
+  acquire(&kc->lock);
+  r->next = kc->freelist;
+  kc->freelist = r;
+  kc->n++;
+  kc->stat.frees++;
+  if(kc->n > KCACHEMAX){
+    // hand a batch back so other CPUs can refill from it.
+    acquire(&kmem.lock);
+    for(int i = 0; i < KBATCH; i++){
+      r = kc->freelist;
+      kc->freelist = r->next;
+      buddy_free(kpgindex(r), 0);
+    }
+    release(&kmem.lock);
+    kc->n -= KBATCH;
+    kc->stat.drains++;
   }
-  if(--kmem.refv[idx] == 0){
-    // Fill with junk to catch dangling refs.
-   kpgfree(pa);
+  release(&kc->lock);
+  pop_off();
+}
+// move up to KBATCH pages from the global pool into kc.
+// caller must hold kc->lock.
+static void krefill(struct kcache *kc) {
+  struct run *r;
+  int n, idx;
+
+  acquire(&kmem.lock);
+  for(n = 0; n < KBATCH && (idx = buddy_alloc(0)) >= 0; n++){
+    r = (struct run *)kpgaddr(idx);
+    r->next = kc->freelist;
+    kc->freelist = r;
   }
   release(&kmem.lock);
+  kc->n += n;
+  if(n > 0)
+    kc->stat.refills++;
 }
-// clean page at pa and put it into the freelist.
-// called by kmeminit during the memory initailization.
-void kpgfree(void* pa){
-  // Fill with junk to catch dangling refs.
-  memset(pa, 1, PGSIZE);
-  struct run *r = (struct run *)pa;
+// take one page from another CPU's cache when both this CPU's
+// cache and the global pool are empty.
+static struct run *ksteal(int self) {
+  struct run *r = 0;
 
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  kmem.freememcnt += PGSIZE;
+  for(int i = 0; i < NCPU && r == 0; i++){
+    if(i == self)
+      continue;
+    acquire(&kcache[i].lock);
+    if((r = kcache[i].freelist) != 0){
+      kcache[i].freelist = r->next;
+      kcache[i].n--;
+    }
+    release(&kcache[i].lock);
+  }
+  return r;
 }
-void kmeminit(void* pa) {
-  int idx = kpgindex(pa);
-  if (idx < 0)
-    panic("kputpage");
+// take one page from the pre-zeroed pool, or return 0.
+static struct run *kzeropop(void) {
+  struct run *r;
+
+  acquire(&kzero.lock);
+  if((r = kzero.freelist) != 0){
+    kzero.freelist = r->next;
+    kzero.n--;
+  }
+  release(&kzero.lock);
+  if(r)
+    r->next = 0;
+  return r;
+}
+// return every page cached by every CPU, and the pre-zeroed
+// pool, to the buddy pool so that they can merge into
+// larger blocks.
+static void kdrainall(void) {
+  struct run *r;
+
+  acquire(&kzero.lock);
   acquire(&kmem.lock);
-  if(kmem.refv[idx] != 0){
-    panic("kmeminit illegal ref");
+  while((r = kzero.freelist) != 0){
+    kzero.freelist = r->next;
+    buddy_free(kpgindex(r), 0);
   }
-  kpgfree(pa);
   release(&kmem.lock);
+  kzero.n = 0;
+  release(&kzero.lock);
+
+  for(int i = 0; i < NCPU; i++){
+    struct kcache *kc = &kcache[i];
+    acquire(&kc->lock);
+    acquire(&kmem.lock);
+    while((r = kc->freelist) != 0){
+      kc->freelist = r->next;
+      buddy_free(kpgindex(r), 0);
+    }
+    release(&kmem.lock);
+    if(kc->n > 0)
+      kc->stat.drains++;
+    kc->n = 0;
+    release(&kc->lock);
+  }
 }
 // Allocate one 4096-byte page of physical memory.
 // Returns a pointer that the kernel can use.
@@ -108,27 +353,256 @@ void kmeminit(void* pa) {
 void *kalloc(void) {
   struct run *r;
 
-  acquire(&kmem.lock);
-  r = kmem.freelist;
+  push_off();
+  int id = cpuid();
+  struct kcache *kc = &kcache[id];
+  acquire(&kc->lock);
+  if(kc->freelist){
+    kc->stat.hits++;
+  } else {
+    kc->stat.misses++;
+    krefill(kc);
+  }
+  r = kc->freelist;
+  if(r){
+    kc->freelist = r->next;
+    kc->n--;
+  }
+  release(&kc->lock);
+  if(r == 0 && (r = ksteal(id)) != 0){
+    acquire(&kc->lock);
+    kc->stat.steals++;
+    release(&kc->lock);
+  }
+  pop_off();
+  if(r == 0)
+    r = kzeropop();
+
   if (r) {
+    // nobody else can reach a free page's count.
     int idx = kpgindex(r);
-    if(idx < 0 || kmem.refv[idx] != 0){
+    if(idx < 0 || refv[idx] != 0){
       panic("kalloc pg index or ref illegal");
     }
-    kmem.refv[idx] = 1;
-    kmem.freelist = r->next;
-    kmem.freememcnt -= PGSIZE;
+    __atomic_store_n(&refv[idx], 1, __ATOMIC_RELEASE);
+    kjunk((char *)r, 5, PGSIZE);  // fill with junk
   }
-  release(&kmem.lock);
+  return (void *)r;
+}
+
+// Allocate one page of physical memory filled with zeros,
+// from the pre-zeroed pool if it has one, so that the caller
+// doesn't pay for clearing it.
+// Returns 0 if the memory cannot be allocated.
+void *kalloc_zeroed(void) {
+  struct run *r;
+  int zeroed = 1;
 
-  if (r) memset((char *)r, 5, PGSIZE);  // fill with junk
+  if((r = kzeropop()) == 0){
+    zeroed = 0;
+    if((r = kalloc()) == 0)
+      return 0;
+    memset((char *)r, 0, PGSIZE);
+  } else {
+    int idx = kpgindex(r);
+    if(idx < 0 || refv[idx] != 0){
+      panic("kalloc_zeroed pg index or ref illegal");
+    }
+    __atomic_store_n(&refv[idx], 1, __ATOMIC_RELEASE);
+  }
+
+  push_off();
+  struct kcache *kc = &kcache[cpuid()];
+  acquire(&kc->lock);
+  if(zeroed)
+    kc->stat.zhits++;
+  else
+    kc->stat.zmisses++;
+  release(&kc->lock);
+  pop_off();
   return (void *)r;
 }
 
+// Called by the scheduler when this CPU has nothing to run:
+// zero a few free pages into the pre-zeroed pool, unless it
+// is already full.
+void kzeroidle(void) {
+  struct run *r;
+  int idx;
+
+  for(int i = 0; i < KZEROBATCH; i++){
+    if(lockfree_read4(&kzero.n) >= KZEROMAX)
+      return;
+    acquire(&kmem.lock);
+    idx = buddy_alloc(0);
+    release(&kmem.lock);
+    if(idx < 0)
+      return;
+    r = (struct run *)kpgaddr(idx);
+    memset((char *)r, 0, PGSIZE);
+    acquire(&kzero.lock);
+    r->next = kzero.freelist;
+    kzero.freelist = r;
+    kzero.n++;
+    release(&kzero.lock);
+  }
+}
+
+// Allocate 2^order physically contiguous pages, aligned
+// to their size. Every page starts with one reference, so
+// the pages can be shared and freed one at a time with
+// kgetpage()/kfree() just like kalloc()ed pages.
+// Returns 0 if no such block is available.
+void *kalloc_order(int order) {
+  int idx;
+
+  if(order < 0 || order > MAXORDER)
+    return 0;
+  if(order == 0)
+    return kalloc();
+
+  acquire(&kmem.lock);
+  idx = buddy_alloc(order);
+  release(&kmem.lock);
+  if(idx < 0){
+    // free pages may be stranded in the CPU caches,
+    // keeping their buddies from merging.
+    kdrainall();
+    acquire(&kmem.lock);
+    idx = buddy_alloc(order);
+    release(&kmem.lock);
+    if(idx < 0)
+      return 0;
+  }
+  for(int i = 0; i < (1 << order); i++){
+    if(refv[idx + i] != 0)
+      panic("kalloc_order ref illegal");
+    __atomic_store_n(&refv[idx + i], 1, __ATOMIC_RELEASE);
+  }
+  kjunk(kpgaddr(idx), 5, PGSIZE << order);  // fill with junk
+  return kpgaddr(idx);
+}
+
+// Drop one reference to each page of a block returned by
+// kalloc_order(order). If no page is still shared the block
+// goes back to the pool in one piece; otherwise the pages that
+// reached zero are freed singly and the rest are freed later
+// by kfree(), merging with their buddies as they arrive.
+void kfree_order(void *pa, int order) {
+  uint64 last[(1 << MAXORDER) / 64 + 1];  // pages we dropped to zero
+  int idx = kpgindex(pa);
+  int n = 1 << order;
+  int nfree = 0;
+
+  if(order == 0){
+    kfree(pa);
+    return;
+  }
+  if(idx < 0 || order > MAXORDER || (idx & (n - 1)) != 0)
+    panic("kfree_order");
+  memset(last, 0, sizeof(last));
+  for(int i = 0; i < n; i++){
+    if(kputref(idx + i)){
+      last[i / 64] |= 1L << (i % 64);
+      nfree++;
+    }
+  }
+
+  if(nfree == n){
+    kjunk(pa, 1, PGSIZE << order);  // fill with junk
+    acquire(&kmem.lock);
+    buddy_free(idx, order);
+    release(&kmem.lock);
+    return;
+  }
+  for(int i = 0; i < n; i++){
+    if(last[i / 64] & (1L << (i % 64))){
+      kjunk(kpgaddr(idx + i), 1, PGSIZE);
+      acquire(&kmem.lock);
+      buddy_free(idx + i, 0);
+      release(&kmem.lock);
+    }
+  }
+}
+
 uint64 kgetfree(void) {
   uint64 cnt = -1;
   acquire(&kmem.lock);
   cnt = kmem.freememcnt;
   release(&kmem.lock);
+  for(int i = 0; i < NCPU; i++){
+    acquire(&kcache[i].lock);
+    cnt += (uint64)kcache[i].n * PGSIZE;
+    release(&kcache[i].lock);
+  }
+  acquire(&kzero.lock);
+  cnt += (uint64)kzero.n * PGSIZE;
+  release(&kzero.lock);
   return cnt;
-}
\ No newline at end of file
+}
+
+// copy out the per-CPU allocator counters.
+void kgetstats(struct kmemstat *st) {
+  for(int i = 0; i < NCPU; i++){
+    acquire(&kcache[i].lock);
+    st[i] = kcache[i].stat;
+    st[i].cached = kcache[i].n;
+    release(&kcache[i].lock);
+  }
+}
+
+#ifdef KJUNK
+// is the page at idx part of a free block of at least order?
+// caller must hold kmem.lock.
+static int buddy_isfree(int idx, int order) {
+  for(int o = order; o <= MAXORDER; o++){
+    if(pgorder[idx & ~((1 << o) - 1)] == o + 1)
+      return 1;
+  }
+  return 0;
+}
+
+// Boot-time check of kalloc_order()/kfree_order(), in KJUNK
+// debug builds only: split, share, free in pieces, and make
+// sure the pieces merge back and the free count comes out
+// where it started. Runs before the other CPUs start, so
+// nothing else moves the counts.
+void kalloc_selftest(void) {
+  uint64 free0 = kgetfree();
+  char *pa[MAXORDER+1];
+  int idx, ok;
+
+  for(int o = 1; o <= MAXORDER; o++){
+    if((pa[o] = kalloc_order(o)) == 0)
+      panic("kalloc_selftest: alloc");
+    if(kpgindex(pa[o]) & ((1 << o) - 1))
+      panic("kalloc_selftest: alignment");
+  }
+  if(kgetfree() != free0 - ((uint64)PGSIZE << (MAXORDER+1)) + 2*PGSIZE)
+    panic("kalloc_selftest: count after alloc");
+  for(int o = 1; o <= MAXORDER; o++)
+    kfree_order(pa[o], o);
+  if(kgetfree() != free0)
+    panic("kalloc_selftest: count after free");
+
+  // free a block while one of its pages is still shared.
+  char *p = kalloc_order(4);
+  idx = kpgindex(p);
+  kgetpage(p + 3*PGSIZE);
+  if(kgetref(p + 3*PGSIZE) != 2)
+    panic("kalloc_selftest: ref");
+  kfree_order(p, 4);
+  acquire(&kmem.lock);
+  ok = !buddy_isfree(idx + 3, 0) && buddy_isfree(idx, 0);
+  release(&kmem.lock);
+  if(!ok || kgetfree() != free0 - PGSIZE)
+    panic("kalloc_selftest: partial free");
+  kfree(p + 3*PGSIZE);
+  kdrainall();  // the last page went to this CPU's cache
+  acquire(&kmem.lock);
+  ok = buddy_isfree(idx, 4);
+  release(&kmem.lock);
+  if(!ok || kgetfree() != free0)
+    panic("kalloc_selftest: coalesce");
+}
+#endif
@@ -6,6 +6,7 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "proc.h"
 
 // Simple logging that allows concurrent FS system calls.
 //
@@ -15,126 +16,499 @@
 // any reasoning required about whether a commit might
 // write an uncommitted system call's updates to disk.
 //
-// A system call should call begin_op()/end_op() to mark
-// its start and end. Usually begin_op() just increments
-// the count of in-progress FS system calls and returns.
-// But if it thinks the log is close to running out, it
-// sleeps until the last outstanding end_op() commits.
+// A system call should call begin_op(n)/end_op() to mark
+// its start and end, where n is the most blocks it may write.
+// Usually begin_op() just reserves n blocks of the open
+// transaction and returns. But if the transaction can't hold
+// them, it sleeps until the last outstanding end_op() commits.
+// A transaction holds at most a quarter of the log, and no
+// more than LOGMAXTX blocks.
 //
 // The log is a physical re-do log containing disk blocks.
+// Committed transactions are appended to it one after another,
+// and their blocks are installed at their home locations only
+// at a checkpoint: when the next transaction doesn't fit, or
+// when the log has been idle for CKPTTICKS. A block logged by
+// many transactions between checkpoints is written home once.
 // The on-disk log format:
-//   header block, containing block #s for block A, B, C, ...
+//   checkpoint block, containing the number of the last
+//     transaction installed
+//   header block, containing a sequence number and
+//     block #s for block A, B, C, ...
 //   block A
 //   block B
 //   block C
 //   ...
-// Log appends are synchronous.
+//   header block of the next transaction
+//   ...
+// A checkpoint starts the log over at the beginning, so
+// recovery replays the transactions found after the checkpoint
+// block for as long as their sequence numbers follow on.
+// A commit waits for each of its stages to reach the disk, but
+// the block writes within a stage are all in flight at once.
+//
+// A commit briefly stops new FS system calls while it copies
+// the transaction's blocks (the snapshot); after that, a new
+// transaction accumulates while the old one is written to the
+// log. Until the checkpoint, the latest committed copy of each
+// logged block is kept aside, since the cached block may hold
+// changes of the open transaction, and the cached block stays
+// pinned, so that it is never re-read from the stale home
+// location.
+//
+// Group commit: with COMMITTICKS > 0, end_op() doesn't commit.
+// A kernel thread, the flusher, commits the open transaction
+// once nobody is in it and it is COMMITTICKS old, or sooner if
+// begin_op() is short of log space or fsync() is waiting, so
+// one commit covers the ops of many system calls. fsync()
+// waits for the commit of the last transaction its process
+// wrote in. With COMMITTICKS == 0 the last end_op() commits,
+// as before.
+//
+// Ordered data: on a file system made with mkfs -o, writei()
+// and iflush() hand file data, and bzero() the zeroing of new
+// blocks, to log_write_data(), which doesn't log it. The commit writes those blocks home
+// before it writes the transaction's header, so committed
+// metadata never points at data that isn't on disk, and each
+// data block is written once instead of twice. Metadata
+// (inodes, bitmaps, indirect and directory blocks) is logged
+// as before. A block logged since the last checkpoint is
+// logged even as data, so that the checkpoint or recovery
+// can't write an older copy over it.
+
+#define LOGMAGIC 0x6c6f6721  // marks a transaction header block
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
 struct logheader {
+  int magic;
+  int seq;
   int n;
-  int block[LOGSIZE];
+  int block[LOGMAXTX];
 };
 
 struct log {
   struct spinlock lock;
   int start;
-  int size;
+  int size;        // blocks after the checkpoint block
+  int txmax;       // most blocks in a transaction
+  int ckmax;       // most blocks awaiting a checkpoint
+  int head;        // where the next transaction goes
   int outstanding; // how many FS sys calls are executing.
-  int committing;  // in commit(), please wait.
+  int reserved;    // blocks they reserved in begin_op()
+  int committing;  // a commit or checkpoint is in progress.
+  int freezing;    // taking the snapshot, please wait.
   int dev;
   struct logheader lh;
+  int txseq;       // number of the open transaction
+  int committed;   // number of the last transaction committed
+  uint opentick;   // when the open transaction logged its first block
+  uint commitick;  // when the last commit was
+  int urgent;      // someone is waiting for the next commit
+  void *flusherchan; // what the flusher sleeps on, if it sleeps
+  int ordered;     // file data isn't logged (SB_ORDERED)
+  int installed;   // number of the last transaction checkpointed
+  int nd;          // data blocks of the open transaction
+  struct buf *data[LOGMAXTX];  // them, pinned
+
+  // statistics.
+  int ncommit;     // transactions committed
+  int nlogged;     // blocks written to the log
+  int nckpt;       // checkpoints
+  int ninstalled;  // blocks written home by checkpoints
+  int ninplace;    // ordered data blocks written home by commits
 };
 struct log log;
 
+// Blocks committed since the last checkpoint, one entry per
+// block number. Only the process committing uses it.
+static struct {
+  int n;
+  struct buf *copy[CKPTBLOCKS];  // bshadow() copies of the latest commits
+  struct buf *home[CKPTBLOCKS];  // pinned cached blocks, or 0
+  struct buf *io[CKPTBLOCKS];    // for write_runs(), which sorts
+} ck;
+
+// The transaction being committed or recovered, which is too
+// big for the stack. Only the process committing uses it.
+static struct {
+  struct logheader lh;
+  struct buf *lbufs[LOGMAXTX];   // its log blocks
+  struct buf *homes[LOGMAXTX];   // its cached blocks
+  int nd;
+  struct buf *data[LOGMAXTX];    // its ordered data blocks
+} cm;
+
 static void recover_from_log(void);
-static void commit();
+static void flusher(void);
+
+extern uint ticks;
 
 void
 initlog(int dev, struct superblock *sb)
 {
+  int budget;
+
   if (sizeof(struct logheader) >= BSIZE)
     panic("initlog: too big logheader");
 
   initlock(&log.lock, "log");
   log.start = sb->logstart;
-  log.size = sb->nlog;
+  log.size = sb->nlog - 1;
+  log.txmax = log.size / 4;
+  if (log.txmax > LOGMAXTX)
+    log.txmax = LOGMAXTX;
+  if (log.txmax < DELAYOPBLOCKS)
+    panic("initlog: log too small");
+
+  // the log keeps buffers in the cache pinned: the open
+  // transaction's, the committing one's and its log blocks,
+  // and the blocks awaiting a checkpoint. fit them in the
+  // cache, leaving room for the FS calls in progress.
+  budget = bcachesize() - 2*MAXOPBLOCKS;
+  if (log.txmax > budget / 4)
+    log.txmax = budget / 4;
+  if (log.txmax < DELAYOPBLOCKS)
+    panic("initlog: buffer cache too small");
+  log.ckmax = budget - 3*log.txmax;
+  if (log.ckmax > CKPTBLOCKS)
+    log.ckmax = CKPTBLOCKS;
   log.dev = dev;
+  log.ordered = (sb->flags & SB_ORDERED) != 0;
   recover_from_log();
+  if(COMMITTICKS > 0)
+    kthread_create("logflush", flusher);
+}
+
+// block i after the checkpoint block.
+static int
+logblock(int i)
+{
+  return log.start + 1 + i;
 }
 
-// Copy committed blocks from log to their home location
+// Start writing bufs, sorted by block number, with one
+// request per run of consecutive blocks.
 static void
-install_trans(int recovering)
+write_runs(struct buf **bufs, int n)
 {
-  int tail;
+  int i, j;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
-    if(recovering == 0)
-      bunpin(dbuf);
-    brelse(lbuf);
-    brelse(dbuf);
+  for(i = 1; i < n; i++){
+    struct buf *b = bufs[i];
+    for(j = i; j > 0 && bufs[j-1]->blockno > b->blockno; j--)
+      bufs[j] = bufs[j-1];
+    bufs[j] = b;
+  }
+  for(i = 0; i < n; i = j){
+    for(j = i + 1; j < n && bufs[j]->blockno == bufs[j-1]->blockno + 1; j++)
+      ;
+    bwritev_start(bufs + i, j - i);
   }
 }
 
-// Read the log header from disk into the in-memory log header
-static void
-read_head(void)
+// Read the transaction header at log position pos into lh.
+// Returns 0 if there is no header of transaction seq there.
+static int
+read_head(int pos, int seq, struct logheader *lh)
 {
-  struct buf *buf = bread(log.dev, log.start);
-  struct logheader *lh = (struct logheader *) (buf->data);
-  int i;
-  log.lh.n = lh->n;
-  for (i = 0; i < log.lh.n; i++) {
-    log.lh.block[i] = lh->block[i];
+  struct buf *buf = bread(log.dev, logblock(pos));
+  struct logheader *hb = (struct logheader *) (buf->data);
+  int i, ok;
+  ok = hb->magic == LOGMAGIC && hb->seq == seq &&
+       hb->n > 0 && hb->n <= LOGMAXTX && pos + 1 + hb->n <= log.size;
+  if (ok) {
+    lh->magic = hb->magic;
+    lh->seq = hb->seq;
+    lh->n = hb->n;
+    for (i = 0; i < lh->n; i++) {
+      lh->block[i] = hb->block[i];
+    }
   }
   brelse(buf);
+  return ok;
 }
 
-// Write in-memory log header to disk.
+// Write lh to the header block at log position pos.
 // This is the true point at which the
-// current transaction commits.
+// transaction commits.
 static void
-write_head(void)
+write_head(int pos, struct logheader *lh)
 {
-  struct buf *buf = bread(log.dev, log.start);
+  struct buf *buf = bread(log.dev, logblock(pos));
   struct logheader *hb = (struct logheader *) (buf->data);
   int i;
-  hb->n = log.lh.n;
-  for (i = 0; i < log.lh.n; i++) {
-    hb->block[i] = log.lh.block[i];
+  hb->magic = lh->magic;
+  hb->seq = lh->seq;
+  hb->n = lh->n;
+  for (i = 0; i < lh->n; i++) {
+    hb->block[i] = lh->block[i];
   }
   bwrite(buf);
   brelse(buf);
 }
 
+// Record in the checkpoint block that transactions up
+// to seq are installed.
+static void
+write_ckpt(int seq)
+{
+  struct buf *buf = bread(log.dev, log.start);
+  *(int *) buf->data = seq;
+  bwrite(buf);
+  brelse(buf);
+}
+
+// Add n blocks of a committed transaction, numbered block[],
+// to the blocks awaiting the checkpoint. lbufs[] hold their
+// committed contents, and are released. homes[], if set, are
+// the cached blocks, each pinned by the transaction.
+static void
+ckpt_add(int n, int *block, struct buf **lbufs, struct buf **homes)
+{
+  int tail, i;
+
+  for (tail = 0; tail < n; tail++) {
+    for (i = 0; i < ck.n; i++)
+      if (ck.copy[i]->blockno == block[tail])
+        break;
+    if (i < ck.n) {
+      // absorbed: only the latest copy will be written home.
+      memmove(ck.copy[i]->data, lbufs[tail]->data, BSIZE);
+      if (homes)
+        bunpin(homes[tail]);
+    } else {
+      if (ck.n >= CKPTBLOCKS)
+        panic("ckpt_add");
+      ck.copy[ck.n] = bshadow(log.dev, block[tail], lbufs[tail]->data);
+      ck.home[ck.n] = homes ? homes[tail] : 0;
+      ck.n++;
+    }
+    brelse(lbufs[tail]);
+  }
+}
+
+// Write the latest committed copy of every block in the log
+// to its home location, then empty the log. The caller must
+// be the only one committing.
+static void
+checkpoint(void)
+{
+  int i, seq;
+
+  memmove(ck.io, ck.copy, ck.n * sizeof(ck.io[0]));
+  write_runs(ck.io, ck.n);  // write dsts to disk
+  for (i = 0; i < ck.n; i++)
+    bwait(ck.io[i]);
+  for (i = 0; i < ck.n; i++) {
+    bshadowfree(ck.copy[i]);
+    if (ck.home[i])
+      bunpin(ck.home[i]);
+  }
+
+  acquire(&log.lock);
+  seq = log.txseq - 1;
+  log.nckpt++;
+  log.ninstalled += ck.n;
+  release(&log.lock);
+
+  write_ckpt(seq);  // the log is empty from here on
+  log.head = 0;
+  ck.n = 0;
+
+  acquire(&log.lock);
+  log.installed = seq;
+  release(&log.lock);
+}
+
 static void
 recover_from_log(void)
 {
-  read_head();
-  install_trans(1); // if committed, copy from log to disk
+  struct logheader *lh = &cm.lh;
+  struct buf *buf;
+  int pos, seq, tail, i, n;
+
+  buf = bread(log.dev, log.start);
+  seq = *(int *) buf->data;
+  brelse(buf);
+
+  // replay the transactions committed after the last checkpoint.
+  for (pos = 0; pos < log.size && read_head(pos, seq+1, lh); pos += 1 + lh->n) {
+    // a few at a time: the cache may be smaller than it was
+    // when the transaction was committed.
+    for (tail = 0; tail < lh->n; tail += n) {
+      n = lh->n - tail < log.txmax ? lh->n - tail : log.txmax;
+      // the log blocks aren't cached yet.
+      for (i = 0; i < n; i++)
+        breadahead(log.dev, logblock(pos+1+tail+i));
+      for (i = 0; i < n; i++)
+        cm.lbufs[i] = bread(log.dev, logblock(pos+1+tail+i));
+      ckpt_add(n, lh->block + tail, cm.lbufs, 0);
+    }
+    seq++;
+  }
+  log.txseq = seq + 1;
+  log.committed = seq;
+  checkpoint();  // install them, and clear the log
+}
+
+// wake the flusher, if it is asleep.
+// caller must hold log.lock.
+static void
+kickflusher(void)
+{
+  if(log.flusherchan)
+    wakeup(log.flusherchan);
+}
+
+// Copy the blocks of transaction lh from the cache into the
+// log blocks after position pos, returned locked in lbufs[].
+// The cached blocks are returned in homes[].
+static void
+snapshot(int pos, struct logheader *lh, struct buf **lbufs, struct buf **homes)
+{
+  int tail;
+
+  for (tail = 0; tail < lh->n; tail++) {
+    struct buf *to = bnew(log.dev, logblock(pos+1+tail)); // log block
+    struct buf *from = bread(log.dev, lh->block[tail]); // cache block
+    memmove(to->data, from->data, BSIZE);
+    homes[tail] = from;
+    brelse(from);
+    lbufs[tail] = to;
+  }
+}
+
+// Write the log blocks. They are consecutive, so they go to
+// the disk together in as few requests as possible.
+static void
+write_log(struct buf **lbufs, int n)
+{
+  int tail;
+
+  bwritev_start(lbufs, n);  // write the log, in one request
+  for (tail = 0; tail < n; tail++)
+    bwait(lbufs[tail]);
+}
+
+// Start writing the ordered data blocks of the transaction
+// being committed to their home locations, and return how
+// many. A block logged since the last checkpoint, by this
+// transaction or the next, goes home from the log instead;
+// it is checked with the block locked, since log_write() is
+// called with it locked.
+static int
+write_data_start(void)
+{
+  int i, n = 0;
+
+  for (i = 0; i < cm.nd; i++) {
+    struct buf *b = bread(log.dev, cm.data[i]->blockno);
+    if (b->logseq > log.installed) {
+      brelse(b);
+      bunpin(b);
+    } else {
+      cm.data[n++] = b;
+    }
+  }
+  write_runs(cm.data, n);
+  return n;
+}
+
+// Wait for the n blocks write_data_start() started.
+static void
+write_data_wait(int n)
+{
+  int i;
+
+  for (i = 0; i < n; i++) {
+    bwait(cm.data[i]);
+    brelse(cm.data[i]);
+    bunpin(cm.data[i]);
+  }
+  acquire(&log.lock);
+  log.ninplace += n;
+  release(&log.lock);
+}
+
+// commit the open transaction. caller must hold log.lock,
+// no FS system calls may be executing, and no other commit
+// may be in progress. If the log is too full, checkpoints
+// instead; the transaction is committed later.
+static void
+docommit(void)
+{
+  struct logheader *lh = &cm.lh;
+  int pos, nd;
+
+  log.committing = 1;
+  if(log.head + 1 + log.lh.n > log.size || ck.n + log.lh.n > log.ckmax){
+    // FS system calls may start during the checkpoint.
+    release(&log.lock);
+    checkpoint();
+    acquire(&log.lock);
+    log.committing = 0;
+    wakeup(&log);
+    return;
+  }
+
+  // take the open transaction, and start a new, empty one.
+  log.freezing = 1;
+  *lh = log.lh;
+  lh->magic = LOGMAGIC;
+  lh->seq = log.txseq++;
+  pos = log.head;
+  log.head += 1 + lh->n;
   log.lh.n = 0;
-  write_head(); // clear the log
+  memmove(cm.data, log.data, log.nd * sizeof(cm.data[0]));
+  cm.nd = log.nd;
+  log.nd = 0;
+  log.urgent = 0;
+
+  // call commit w/o holding locks, since not allowed
+  // to sleep with locks.
+  release(&log.lock);
+  snapshot(pos, lh, cm.lbufs, cm.homes);
+  acquire(&log.lock);
+  log.freezing = 0;
+  wakeup(&log);
+  release(&log.lock);
+
+  nd = write_data_start();     // Write ordered data home
+  write_log(cm.lbufs, lh->n);  // Write modified blocks from cache to log
+  write_data_wait(nd);
+  write_head(pos, lh);         // Write header to disk -- the real commit
+  ckpt_add(lh->n, lh->block, cm.lbufs, cm.homes);
+
+  acquire(&log.lock);
+  log.committed = lh->seq;
+  log.commitick = ticks;
+  log.ncommit++;
+  log.nlogged += lh->n;
+  log.committing = 0;
+  wakeup(&log);
 }
 
-// called at the start of each FS system call.
+// called at the start of each FS system call, which
+// may write up to n blocks.
 void
-begin_op(void)
+begin_op(int n)
 {
+  if(n > log.txmax)
+    panic("begin_op: too many blocks");
   acquire(&log.lock);
   while(1){
-    if(log.committing){
+    if(log.freezing){
       sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
+    } else if(log.lh.n + log.nd + log.reserved + n > log.txmax){
       // this op might exhaust log space; wait for commit.
+      log.urgent = 1;
+      kickflusher();
       sleep(&log, &log.lock);
     } else {
       log.outstanding += 1;
+      log.reserved += n;
+      myproc()->logres = n;
       release(&log.lock);
       break;
     }
@@ -142,69 +516,104 @@ begin_op(void)
 }
 
 // called at the end of each FS system call.
-// commits if this was the last outstanding operation.
+// commits if this was the last outstanding operation,
+// unless the flusher does group commits.
 void
 end_op(void)
 {
-  int do_commit = 0;
-
   acquire(&log.lock);
   log.outstanding -= 1;
-  if(log.committing)
-    panic("log.committing");
+  log.reserved -= myproc()->logres;
+  if(log.freezing)
+    panic("log.freezing");
+  myproc()->lasttx = log.txseq;
   if(log.outstanding == 0){
-    do_commit = 1;
-    log.committing = 1;
+    if(COMMITTICKS == 0){
+      // docommit() may only make room, by checkpointing.
+      while(1){
+        if(log.committing)
+          sleep(&log, &log.lock);
+        else if(log.outstanding == 0 && log.lh.n > 0)
+          docommit();
+        else
+          break;
+      }
+    } else if(log.urgent){
+      kickflusher();
+    }
   } else {
     // begin_op() may be waiting for log space,
-    // and decrementing log.outstanding has decreased
-    // the amount of reserved space.
+    // and this op's reservation has been given back.
     wakeup(&log);
   }
   release(&log.lock);
+}
 
-  if(do_commit){
-    // call commit w/o holding locks, since not allowed
-    // to sleep with locks.
-    commit();
-    acquire(&log.lock);
-    log.committing = 0;
-    wakeup(&log);
-    release(&log.lock);
-  }
+// The most blocks one op should reserve in begin_op(): half
+// a transaction, so that two big writers can share one
+// rather than each waiting for the other's commit. At least
+// DELAYOPBLOCKS, since initlog() checked txmax.
+int
+log_opmax(void)
+{
+  return log.txmax / 2 > DELAYOPBLOCKS ? log.txmax / 2 : DELAYOPBLOCKS;
 }
 
-// Copy modified blocks from cache to log.
-static void
-write_log(void)
+// Wait until the last transaction this process wrote in
+// is on disk. end_op() records it in p->lasttx; since one
+// transaction holds many processes' ops, this may also
+// flush other processes' changes, never fewer of ours.
+void
+log_sync(void)
 {
-  int tail;
+  int tx = myproc()->lasttx;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
-    struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
-    memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
-    brelse(from);
-    brelse(to);
+  acquire(&log.lock);
+  while(log.committed < tx){
+    if(tx == log.txseq){
+      if(log.lh.n == 0)
+        break;  // the open transaction has nothing of ours
+      log.urgent = 1;
+      kickflusher();
+    }
+    sleep(&log, &log.lock);
   }
+  release(&log.lock);
 }
 
+// The group commit thread. It also checkpoints the log once
+// no transaction has committed for CKPTTICKS.
 static void
-commit()
+flusher(void)
 {
-  if (log.lh.n > 0) {
-    write_log();     // Write modified blocks from cache to log
-    write_head();    // Write header to disk -- the real commit
-    install_trans(0); // Now install writes to home locations
-    log.lh.n = 0;
-    write_head();    // Erase the transaction from the log
+  acquire(&log.lock);
+  for(;;){
+    if(log.lh.n > 0 && log.outstanding == 0 &&
+       (log.urgent || ticks - log.opentick >= COMMITTICKS)){
+      docommit();
+    } else if(log.lh.n == 0 && ck.n > 0 &&
+              ticks - log.commitick >= CKPTTICKS){
+      log.committing = 1;
+      release(&log.lock);
+      checkpoint();
+      acquire(&log.lock);
+      log.committing = 0;
+    } else if(log.lh.n > 0 || ck.n > 0){
+      // look again at the next clock tick.
+      log.flusherchan = &ticks;
+      sleep(&ticks, &log.lock);
+    } else {
+      log.urgent = 0;
+      log.flusherchan = &log.flusherchan;
+      sleep(&log.flusherchan, &log.lock);
+    }
+    log.flusherchan = 0;
   }
 }
 
 // Caller has modified b->data and is done with the buffer.
 // Record the block number and pin in the cache by increasing refcnt.
-// commit()/write_log() will do the disk write.
+// docommit() will do the disk write.
 //
 // log_write() replaces bwrite(); a typical use is:
 //   bp = bread(...)
@@ -217,7 +626,14 @@ log_write(struct buf *b)
   int i;
 
   acquire(&log.lock);
-  if (log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1)
+  for (i = 0; i < log.nd; i++) {
+    if (log.data[i] == b) {  // zeroed by bzero(), and now metadata
+      log.data[i] = log.data[--log.nd];
+      bunpin(b);
+      break;
+    }
+  }
+  if (log.lh.n + log.nd >= log.txmax)
     panic("too big a transaction");
   if (log.outstanding < 1)
     panic("log_write outside of trans");
@@ -227,6 +643,11 @@ log_write(struct buf *b)
       break;
   }
   log.lh.block[i] = b->blockno;
+  b->logseq = log.txseq;
+  if (log.lh.n == 0) {
+    log.opentick = ticks;
+    kickflusher();
+  }
   if (i == log.lh.n) {  // Add new block to log?
     bpin(b);
     log.lh.n++;
@@ -234,3 +655,57 @@ log_write(struct buf *b)
   release(&log.lock);
 }
 
+// log_write() for a block of file data. In ordered mode the
+// block is pinned until the commit writes it home, rather
+// than logged, unless it is in the log already. The op must
+// log something too (writei() and iflush() log the inode),
+// or there is no transaction to commit it with.
+void
+log_write_data(struct buf *b)
+{
+  int i;
+
+  acquire(&log.lock);
+  if (!log.ordered || b->logseq > log.installed) {
+    release(&log.lock);
+    log_write(b);
+    return;
+  }
+  if (log.lh.n + log.nd >= log.txmax)
+    panic("too big a transaction");
+  if (log.outstanding < 1)
+    panic("log_write_data outside of trans");
+
+  for (i = 0; i < log.nd; i++) {
+    if (log.data[i] == b)   // written again before the commit
+      break;
+  }
+  if (i == log.nd) {
+    bpin(b);
+    log.data[log.nd++] = b;
+  }
+  release(&log.lock);
+}
+
+
+// Print commit and checkpoint counters into buf. blocks
+// logged per block installed shows how much checkpointing
+// saves over installing after each commit.
+int
+statslog(char *buf, int sz)
+{
+  int n;
+
+  acquire(&log.lock);
+  n = snprintf(buf, sz, "--- log\n"
+               "log: %d commits %d blocks logged %d checkpoints "
+               "%d blocks installed, %d blocks to install\n",
+               log.ncommit, log.nlogged, log.nckpt, log.ninstalled, ck.n);
+  n += snprintf(buf+n, sz-n, "log: at most %d blocks per transaction, "
+                "%d awaiting a checkpoint\n", log.txmax, log.ckmax);
+  if(log.ordered)
+    n += snprintf(buf+n, sz-n, "log: ordered data, %d blocks written in place\n",
+                  log.ninplace);
+  release(&log.lock);
+  return n;
+}
@@ -6,33 +6,58 @@
 
 volatile static int started = 0;
 
+// boot-phase timing. the time CSR runs at 10 MHz on qemu's
+// virt machine.
+#define TIMEFREQ 10000000
+#define BOOTPHASE(call) do { \
+    uint64 t0 = r_time(); \
+    call; \
+    bootphase(#call, t0); \
+  } while(0)
+
+static void
+bootphase(char *name, uint64 t0)
+{
+  uint64 us = (r_time() - t0) / (TIMEFREQ / 1000000);
+  printf("boot: %s %d us\n", name, (int)us);
+}
+
 // start() jumps here in supervisor mode on all CPUs.
 void
 main()
 {
   if(cpuid() == 0){
     consoleinit();
-    // statsinit();
+    statsinit();
     printfinit();
     printf("\n");
     printf("xv6 kernel is booting\n");
     printf("\n");
-    kinit();         // physical page allocator
-    kvminit();       // create kernel page table
-    kvminithart();   // turn on paging
-    procinit();      // process table
-    trapinit();      // trap vectors
-    trapinithart();  // install kernel trap vector
-    plicinit();      // set up interrupt controller
-    plicinithart();  // ask PLIC for device interrupts
-    binit();         // buffer cache
-    iinit();         // inode table
-    fileinit();      // file table
-    virtio_disk_init(); // emulated hard disk
-    pci_init();
-    sockinit();
-    userinit();      // first user process
+    uint64 boot = r_time();
+    BOOTPHASE(kinit());            // physical page allocator
+#ifdef KJUNK
+    BOOTPHASE(kalloc_selftest());  // check kalloc_order()/kfree_order()
+#endif
+    BOOTPHASE(slabinit());         // small object caches
+    BOOTPHASE(kvminit());          // create kernel page table
+    BOOTPHASE(kvminithart());      // turn on paging
+    BOOTPHASE(procinit());         // process table
+    BOOTPHASE(trapinit());         // trap vectors
+    BOOTPHASE(trapinithart());     // install kernel trap vector
+    BOOTPHASE(plicinit());         // set up interrupt controller
+    BOOTPHASE(plicinithart());     // ask PLIC for device interrupts
+    BOOTPHASE(binit());            // buffer cache
+    BOOTPHASE(iinit());            // inode table
+    BOOTPHASE(fileinit());         // file table
+    BOOTPHASE(pipeinit());         // pipe cache
+    BOOTPHASE(iosched_init());     // disk request queue
+    BOOTPHASE(virtio_disk_init()); // emulated hard disk
+    BOOTPHASE(mbufinit());         // packet buffer cache
+    BOOTPHASE(pci_init());
+    BOOTPHASE(sockinit());
+    BOOTPHASE(userinit());         // first user process
     // kcsaninit();
+    printf("boot: total %d us\n", (int)((r_time() - boot) / (TIMEFREQ / 1000000)));
     __sync_synchronize();
     started = 1;
   } else {
@@ -50,6 +50,8 @@
 #define PHYSTOP (KERNBASE + 128*1024*1024)
 
 #define PHYPAGENUM ((PHYSTOP-KERNBASE)/PGSIZE)
+// largest kalloc_order() block is 2^MAXORDER pages.
+#define MAXORDER 10
 // map the trampoline page to the highest address,
 // in both user and kernel space.
 #define TRAMPOLINE (MAXVA - PGSIZE)
@@ -63,6 +63,14 @@ mbuftrim(struct mbuf *m, unsigned int len)
   return m->head + m->len;
 }
 
+static struct kmem_cache *mbufcache;
+
+void
+mbufinit(void)
+{
+  mbufcache = kmem_cache_create("mbuf", sizeof(struct mbuf));
+}
+
 // Allocates a packet buffer.
 struct mbuf *
 mbufalloc(unsigned int headroom)
@@ -71,7 +79,7 @@ mbufalloc(unsigned int headroom)
  
   if (headroom > MBUF_SIZE)
     return 0;
-  m = kalloc();
+  m = kmem_cache_alloc(mbufcache);
   if (m == 0)
     return 0;
   m->next = 0;
@@ -85,7 +93,7 @@ mbufalloc(unsigned int headroom)
 void
 mbuffree(struct mbuf *m)
 {
-  kfree(m);
+  kmem_cache_free(mbufcache, m);
 }
 
 // Pushes an mbuf to the end of the queue.
@@ -1,14 +1,28 @@
+#ifndef _PARAM_H_
+#define _PARAM_H_
 #define NPROC        64  // maximum number of processes
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
+#define NINODE      200  // i-nodes kept in memory after their last reference
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
+#define NDELAY       16  // max blocks of a file awaiting allocation
+#define DELAYOPBLOCKS (2*NDELAY+4)  // max # of blocks allocating them writes
+#define DIRSPLITS     2  // max hashed directory block splits per op
+#define DIROPBLOCKS  (MAXOPBLOCKS+12+5*DIRSPLITS)  // max # of blocks an op adding a directory entry writes
+#define LOGMAXTX     250  // max data blocks in a transaction
+#define LOGBLOCKS    250  // default size of the on-disk log; mkfs -l
+#define CKPTBLOCKS   256  // max blocks awaiting a log checkpoint
+#define NBUF         (4*DELAYOPBLOCKS+2*MAXOPBLOCKS)  // min size of disk block cache; see initlog()
 #define FSSIZE       80000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
-#define MAXVMA       16
\ No newline at end of file
+#define NDCACHE      256  // name cache entries
+#define MAXVMA       16
+#define RAWINDOW     16  // max blocks read ahead of a sequential reader
+#define IOSCHED      "elevator"  // disk scheduling policy: noop or elevator
+#define COMMITTICKS   1  // group commit delay; 0 commits at each end_op
+#define CKPTTICKS    10  // idle time before the log is checkpointed
+#endif
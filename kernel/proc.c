@@ -137,7 +137,7 @@ found:
     return 0;
   }
   // Alloc a usyscall page.
-  if ((p->roregion = (struct usyscall *)kalloc()) == 0) {
+  if ((p->roregion = (struct usyscall *)kalloc_zeroed()) == 0) {
     freeproc(p);
     release(&p->lock);
     return 0;
@@ -156,6 +156,9 @@ found:
   p->roregion->pid = p->pid;
   p->context.ra = (uint64)forkret;
   p->context.sp = p->kstack + PGSIZE;
+  p->lasttx = 0;
+  p->logres = 0;
+  p->kfn = 0;
 
   return p;
 }
@@ -271,6 +274,30 @@ void userinit(void) {
   release(&p->lock);
 }
 
+// A kernel thread's very first scheduling by scheduler()
+// will swtch here.
+static void kthreadret(void) {
+  struct proc *p = myproc();
+
+  // Still holding p->lock from scheduler.
+  release(&p->lock);
+  p->kfn();
+  panic("kthread returned");
+}
+
+// Start a process that runs fn in the kernel and never
+// returns to user space. fn must not return.
+void kthread_create(char *name, void (*fn)(void)) {
+  struct proc *p;
+
+  if ((p = allocproc()) == 0) panic("kthread_create");
+  p->kfn = fn;
+  p->context.ra = (uint64)kthreadret;
+  safestrcpy(p->name, name, sizeof(p->name));
+  p->state = RUNNABLE;
+  release(&p->lock);
+}
+
 // Grow or shrink user memory by n bytes.
 // Return 0 on success, -1 on failure.
 int growproc(int n) {
@@ -394,7 +421,7 @@ void exit(int status) {
       }
   }
   
-  begin_op();
+  begin_op(MAXOPBLOCKS);
   iput(p->cwd);
   end_op();
   p->cwd = 0;
@@ -482,9 +509,11 @@ void scheduler(void) {
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
 
+    int found = 0;
     for (p = proc; p < &proc[NPROC]; p++) {
       acquire(&p->lock);
       if (p->state == RUNNABLE) {
+        found = 1;
         // Switch to chosen process.  It is the process's job
         // to release its lock and then reacquire it
         // before jumping back to us.
@@ -498,6 +527,10 @@ void scheduler(void) {
       }
       release(&p->lock);
     }
+    if (!found) {
+      // nothing to run; clear some free pages for kalloc_zeroed().
+      kzeroidle();
+    }
   }
 }
 
@@ -125,4 +125,7 @@ struct proc {
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
   struct VMA vma[MAXVMA];      // keep track of what mmap has mapped for proc
+  int lasttx;                  // last log transaction this process wrote in; see log_sync()
+  int logres;                  // log blocks reserved by begin_op()
+  void (*kfn)(void);           // body of a kernel thread, else 0
 };
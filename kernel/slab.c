@@ -0,0 +1,279 @@
+// Slab allocator for small, fixed-size kernel objects.
+//
+// A cache hands out objects of one size. Objects are carved
+// out of slabs: blocks of 2^order pages from kalloc_order(),
+// each starting with a struct slab header followed by as many
+// objects as fit. Because buddy blocks are aligned to their
+// size, the header of the slab holding an object is found by
+// rounding the object's address down to the slab size.
+//
+// Each CPU keeps a small magazine of free objects per cache, so
+// kmem_cache_alloc()/kmem_cache_free() normally run with only
+// interrupts disabled. The cache lock is taken to move half a
+// magazine between the magazine and the slabs.
+//
+// Interface:
+// * kmem_cache_create(name, size) at boot, once per object type.
+// * kmem_cache_alloc(c) returns an object (not zeroed), or 0.
+// * kmem_cache_free(c, obj) gives it back.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "defs.h"
+
+#define NSLABCACHE 16   // maximum number of caches
+#define MAGSIZE    16   // objects per CPU magazine
+#define SLABALIGN   8   // object alignment
+
+struct slab {
+  struct kmem_cache *cache;
+  struct slab *next;      // on cache's partial, full or empty list
+  struct slab *prev;
+  void *freelist;         // free objects, linked through their first word
+  int inuse;              // objects not on freelist
+};
+
+struct magazine {
+  int n;
+  void *obj[MAGSIZE];
+  uint64 nalloc;          // objects handed out on this CPU
+  uint64 nfree;           // objects given back on this CPU
+};
+
+struct kmem_cache {
+  struct spinlock lock;   // protects the slab lists
+  char *name;
+  uint size;              // object size, rounded up to SLABALIGN
+  int order;              // slabs are 2^order pages
+  int perslab;            // objects per slab
+  struct slab *partial;   // some objects free
+  struct slab *full;      // no objects free
+  struct slab *empty;     // all objects free
+  int nslabs;
+  struct magazine mag[NCPU];
+};
+
+struct {
+  struct spinlock lock;
+  int n;
+  struct kmem_cache cache[NSLABCACHE];
+} slabtable;
+
+void
+slabinit(void)
+{
+  initlock(&slabtable.lock, "slabtable");
+}
+
+static int
+objsperslab(uint size, int order)
+{
+  return ((PGSIZE << order) - sizeof(struct slab)) / size;
+}
+
+// Create a cache of objects of the given size.
+// Slabs are made just big enough that no more than
+// an eighth of each is wasted.
+struct kmem_cache*
+kmem_cache_create(char *name, uint size)
+{
+  struct kmem_cache *c;
+  int order;
+
+  size = (size + SLABALIGN - 1) & ~(SLABALIGN - 1);
+  for(order = 0; order < 3; order++){
+    int n = objsperslab(size, order);
+    if(n > 0 && (PGSIZE << order) - n * size <= (PGSIZE << order) / 8)
+      break;
+  }
+  if(objsperslab(size, order) == 0)
+    panic("kmem_cache_create: object too big");
+
+  acquire(&slabtable.lock);
+  if(slabtable.n >= NSLABCACHE)
+    panic("kmem_cache_create: too many caches");
+  c = &slabtable.cache[slabtable.n++];
+  release(&slabtable.lock);
+
+  memset(c, 0, sizeof(*c));
+  initlock(&c->lock, "slab");
+  c->name = name;
+  c->size = size;
+  c->order = order;
+  c->perslab = objsperslab(size, order);
+  return c;
+}
+
+static void
+slab_unlink(struct slab **list, struct slab *s)
+{
+  if(s->prev)
+    s->prev->next = s->next;
+  else
+    *list = s->next;
+  if(s->next)
+    s->next->prev = s->prev;
+}
+
+static void
+slab_push(struct slab **list, struct slab *s)
+{
+  s->prev = 0;
+  s->next = *list;
+  if(s->next)
+    s->next->prev = s;
+  *list = s;
+}
+
+// Allocate and format a new slab.
+// Caller must hold c->lock.
+static struct slab*
+slab_grow(struct kmem_cache *c)
+{
+  struct slab *s;
+  char *p;
+
+  if((s = kalloc_order(c->order)) == 0)
+    return 0;
+  s->cache = c;
+  s->inuse = 0;
+  s->freelist = 0;
+  p = (char*)s + sizeof(struct slab);
+  for(int i = c->perslab - 1; i >= 0; i--){
+    void **obj = (void**)(p + i * c->size);
+    *obj = s->freelist;
+    s->freelist = obj;
+  }
+  slab_push(&c->empty, s);
+  c->nslabs++;
+  return s;
+}
+
+// Move up to half a magazine of objects from the slabs into m.
+// Caller must hold c->lock.
+static void
+mag_refill(struct kmem_cache *c, struct magazine *m)
+{
+  struct slab *s;
+
+  while(m->n < MAGSIZE / 2){
+    if((s = c->partial) != 0){
+      slab_unlink(&c->partial, s);
+    } else if((s = c->empty) != 0){
+      slab_unlink(&c->empty, s);
+    } else if(slab_grow(c) != 0){
+      s = c->empty;
+      slab_unlink(&c->empty, s);
+    } else {
+      break;
+    }
+    while(s->freelist && m->n < MAGSIZE / 2){
+      void **obj = s->freelist;
+      s->freelist = *obj;
+      s->inuse++;
+      m->obj[m->n++] = obj;
+    }
+    if(s->freelist)
+      slab_push(&c->partial, s);
+    else
+      slab_push(&c->full, s);
+  }
+}
+
+// Return half of m's objects to their slabs, and release
+// slabs that become entirely free beyond the first one.
+// Caller must hold c->lock.
+static void
+mag_flush(struct kmem_cache *c, struct magazine *m)
+{
+  while(m->n > MAGSIZE / 2){
+    void **obj = m->obj[--m->n];
+    struct slab *s = (struct slab*)((uint64)obj & ~((uint64)(PGSIZE << c->order) - 1));
+    if(s->cache != c)
+      panic("kmem_cache_free: wrong cache");
+    slab_unlink(s->freelist ? &c->partial : &c->full, s);
+    *obj = s->freelist;
+    s->freelist = obj;
+    if(--s->inuse > 0){
+      slab_push(&c->partial, s);
+    } else if(c->empty == 0){
+      slab_push(&c->empty, s);
+    } else {
+      c->nslabs--;
+      kfree_order(s, c->order);
+    }
+  }
+}
+
+void*
+kmem_cache_alloc(struct kmem_cache *c)
+{
+  void *obj = 0;
+
+  push_off();
+  struct magazine *m = &c->mag[cpuid()];
+  if(m->n == 0){
+    acquire(&c->lock);
+    mag_refill(c, m);
+    release(&c->lock);
+  }
+  if(m->n > 0){
+    obj = m->obj[--m->n];
+    m->nalloc++;
+  }
+  pop_off();
+  return obj;
+}
+
+void
+kmem_cache_free(struct kmem_cache *c, void *obj)
+{
+  push_off();
+  struct magazine *m = &c->mag[cpuid()];
+  if(m->n == MAGSIZE){
+    acquire(&c->lock);
+    mag_flush(c, m);
+    release(&c->lock);
+  }
+  m->obj[m->n++] = obj;
+  m->nfree++;
+  pop_off();
+}
+
+// Print per-cache occupancy into buf.
+// active objects are held by callers; cached ones sit
+// in CPU magazines; the rest of the slab space is free.
+int
+statsslab(char *buf, int sz)
+{
+  int n;
+
+  n = snprintf(buf, sz, "--- slab caches\n");
+  acquire(&slabtable.lock);
+  for(int i = 0; i < slabtable.n; i++){
+    struct kmem_cache *c = &slabtable.cache[i];
+    uint64 nalloc = 0, nfree = 0;
+    int cached = 0;
+
+    acquire(&c->lock);
+    for(int j = 0; j < NCPU; j++){
+      nalloc += c->mag[j].nalloc;
+      nfree += c->mag[j].nfree;
+      cached += c->mag[j].n;
+    }
+    int total = c->nslabs * c->perslab;
+    int active = nalloc - nfree;
+    n += snprintf(buf+n, sz-n,
+                  "slab: %s: size %d pages/slab %d objs/slab %d slabs %d "
+                  "active %d cached %d occupancy %d%% allocs %d\n",
+                  c->name, c->size, 1 << c->order, c->perslab, c->nslabs,
+                  active, cached, total ? (active * 100) / total : 0,
+                  (int)nalloc);
+    release(&c->lock);
+  }
+  release(&slabtable.lock);
+  return n;
+}
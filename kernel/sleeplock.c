@@ -12,7 +12,7 @@
 void
 initsleeplock(struct sleeplock *lk, char *name)
 {
-  initlock(&lk->lk, "sleep lock");
+  initlock_unlisted(&lk->lk, "sleep lock");
   lk->name = name;
   lk->locked = 0;
   lk->pid = 0;
@@ -51,5 +51,74 @@ holdingsleep(struct sleeplock *lk)
   return r;
 }
 
+// Reader/writer sleeping locks. A process waiting for
+// exclusive access holds off new shared holders, so that a
+// stream of readers can't starve it.
+
+void
+initrwsleeplock(struct rwsleeplock *lk, char *name)
+{
+  initlock_unlisted(&lk->lk, "rw sleep lock");
+  lk->name = name;
+  lk->readers = 0;
+  lk->writer = 0;
+  lk->wwait = 0;
+  lk->pid = 0;
+}
+
+void
+acquireshared(struct rwsleeplock *lk)
+{
+  acquire(&lk->lk);
+  while (lk->writer || lk->wwait > 0) {
+    sleep(lk, &lk->lk);
+  }
+  lk->readers++;
+  release(&lk->lk);
+}
+
+void
+acquireexcl(struct rwsleeplock *lk)
+{
+  acquire(&lk->lk);
+  lk->wwait++;
+  while (lk->writer || lk->readers > 0) {
+    sleep(lk, &lk->lk);
+  }
+  lk->wwait--;
+  lk->writer = 1;
+  lk->pid = myproc()->pid;
+  release(&lk->lk);
+}
+
+// Release lk, held in either mode.
+void
+releaserw(struct rwsleeplock *lk)
+{
+  acquire(&lk->lk);
+  if (lk->writer) {
+    lk->writer = 0;
+    lk->pid = 0;
+    wakeup(lk);
+  } else if (--lk->readers == 0) {
+    wakeup(lk);
+  }
+  release(&lk->lk);
+}
+
+// Is lk held exclusive by this process, or shared by anyone?
+// shared holders aren't recorded, so this can't tell whether
+// the caller is one of them.
+int
+holdingrw(struct rwsleeplock *lk)
+{
+  int r;
+
+  acquire(&lk->lk);
+  r = (lk->writer && lk->pid == myproc()->pid) || lk->readers > 0;
+  release(&lk->lk);
+  return r;
+}
+
 
 
@@ -9,5 +9,18 @@ struct sleeplock {
   char *name;        // Name of lock.
   int pid;           // Process holding lock
 };
+
+// Long-term lock that any number of processes may hold
+// shared, or one may hold exclusive.
+struct rwsleeplock {
+  struct spinlock lk; // spinlock protecting this sleep lock
+  int readers;       // shared holders
+  uint writer;       // held exclusive?
+  int wwait;         // waiting for exclusive; new readers wait too
+
+  // For debugging:
+  char *name;        // Name of lock.
+  int pid;           // Process holding lock exclusive
+};
 #endif
 
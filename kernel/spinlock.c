@@ -39,14 +39,25 @@ findslot(struct spinlock *lk) {
   }
   panic("findslot");
 }
+// like initlock(), but leave the lock out of the locks[]
+// table that statslock() reports, so that it needs no
+// freelock() and doesn't count against NLOCK. for the
+// spinlocks inside sleep locks, of which there is one per
+// cached buffer and inode.
 void
-initlock(struct spinlock *lk, char *name)
+initlock_unlisted(struct spinlock *lk, char *name)
 {
   lk->name = name;
   lk->locked = 0;
   lk->cpu = 0;
   lk->nts = 0;
   lk->n = 0;
+}
+
+void
+initlock(struct spinlock *lk, char *name)
+{
+  initlock_unlisted(lk, name);
   findslot(lk);
 }
 
@@ -179,11 +190,30 @@ statslock(char *buf, int sz) {
   n = snprintf(buf, sz, "--- lock kmem/bcache stats\n");
   for(int i = 0; i < NLOCK; i++) {
     if(locks[i] == 0)
-      break;
+      continue;
     if(strncmp(locks[i]->name, "bcache", strlen("bcache")) == 0 ||
        strncmp(locks[i]->name, "kmem", strlen("kmem")) == 0) {
-      tot += locks[i]->nts;
-      n += snprint_lock(buf +n, sz-n, locks[i]);
+      // locks sharing a name (one per CPU or per bucket)
+      // are summed into one line, printed at the first.
+      int j, nts = 0, cnt = 0, nlk = 0;
+      for(j = 0; j < i; j++)
+        if(locks[j] && strncmp(locks[j]->name, locks[i]->name, 32) == 0)
+          break;
+      if(j < i)
+        continue;
+      for(j = i; j < NLOCK; j++) {
+        if(locks[j] && strncmp(locks[j]->name, locks[i]->name, 32) == 0) {
+          nts += locks[j]->nts;
+          cnt += locks[j]->n;
+          nlk++;
+        }
+      }
+      tot += nts;
+      if(nlk == 1)
+        n += snprint_lock(buf +n, sz-n, locks[i]);
+      else if(cnt > 0)
+        n += snprintf(buf+n, sz-n, "lock: %s (x%d): #test-and-set %d #acquire() %d\n",
+                      locks[i]->name, nlk, nts, cnt);
     }
   }
   
@@ -191,14 +221,16 @@ statslock(char *buf, int sz) {
   int last = 100000000;
   // stupid way to compute top 5 contended locks
   for(int t = 0; t < 5; t++) {
-    int top = 0;
+    int top = -1;
     for(int i = 0; i < NLOCK; i++) {
       if(locks[i] == 0)
-        break;
-      if(locks[i]->nts > locks[top]->nts && locks[i]->nts < last) {
+        continue;
+      if((top < 0 || locks[i]->nts > locks[top]->nts) && locks[i]->nts < last) {
         top = i;
       }
     }
+    if(top < 0)
+      break;
     n += snprint_lock(buf+n, sz-n, locks[top]);
     last = locks[top]->nts;
   }
@@ -0,0 +1,81 @@
+//
+// the "statistics" device: a read-only text report of
+// kernel counters, regenerated each time it is read from
+// the start.
+//
+
+#include <stdarg.h>
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "riscv.h"
+#include "defs.h"
+
+#define BUFSZ 8192
+#define SLACK 32    // snprintf() may overrun its size by one number
+
+// each appends one section of the report.
+static int (*reporters[])(char*, int) = {
+  statslock,
+  statsslab,
+  statsbio,
+  statsitable,
+  statsdcache,
+  statslog,
+  statsiosched,
+};
+
+static struct {
+  struct spinlock lock;
+  char buf[BUFSZ];
+  int sz;
+  int off;
+} stats;
+
+int
+statswrite(int user_src, uint64 src, int n)
+{
+  return -1;
+}
+
+int
+statsread(int user_dst, uint64 dst, int n)
+{
+  int m;
+
+  acquire(&stats.lock);
+
+  if(stats.sz == 0) {
+    for(int i = 0; i < NELEM(reporters); i++)
+      stats.sz += reporters[i](stats.buf+stats.sz, BUFSZ-SLACK-stats.sz);
+  }
+  m = stats.sz - stats.off;
+
+  if (m > 0) {
+    if(m > n)
+      m  = n;
+    if(either_copyout(user_dst, dst, stats.buf+stats.off, m) != -1) {
+      stats.off += m;
+    }
+  } else {
+    // end of report; the next read starts a fresh one.
+    m = 0;
+    stats.sz = 0;
+    stats.off = 0;
+  }
+  release(&stats.lock);
+  return m;
+}
+
+void
+statsinit(void)
+{
+  initlock(&stats.lock, "stats");
+
+  devsw[STATS].read = statsread;
+  devsw[STATS].write = statswrite;
+}
@@ -117,6 +117,12 @@ extern uint64 sys_connect(void);
 extern uint64 sys_symlink(void);
 extern uint64 sys_mmap(void);
 extern uint64 sys_munmap(void);
+extern uint64 sys_fsync(void);
+extern uint64 sys_fibmap(void);
+extern uint64 sys_pread(void);
+extern uint64 sys_pwrite(void);
+extern uint64 sys_readv(void);
+extern uint64 sys_writev(void);
 
 // An array mapping syscall numbers from syscall.h
 // to the function that handles the system call.
@@ -151,6 +157,12 @@ static uint64 (*syscalls[])(void) = {
 [SYS_symlink]    sys_symlink,
 [SYS_mmap]       sys_mmap,
 [SYS_munmap]      sys_munmap,
+[SYS_fsync]       sys_fsync,
+[SYS_fibmap]      sys_fibmap,
+[SYS_pread]       sys_pread,
+[SYS_pwrite]      sys_pwrite,
+[SYS_readv]       sys_readv,
+[SYS_writev]      sys_writev,
 };
 
 // An array mapping syscall numbers from syscall.h
@@ -183,7 +195,13 @@ static const char* syscallnames[] = {
 [SYS_connect]   "connect",
 [SYS_symlink]   "symlink",
 [SYS_mmap]      "mmap",
-[SYS_munmap]    "munmap"
+[SYS_munmap]    "munmap",
+[SYS_fsync]     "fsync",
+[SYS_fibmap]    "fibmap",
+[SYS_pread]     "pread",
+[SYS_pwrite]    "pwrite",
+[SYS_readv]     "readv",
+[SYS_writev]    "writev"
 };
 
 void
@@ -202,7 +220,7 @@ syscall(void)
     int pid;
     pmask = p->tracemask;
     pid=p->pid;
-    if(pmask&(1<<num)){
+    if(num < 64 && (pmask & (1L << num))){  // one bit per syscall
       printf("%d: syscall %s -> %l\n",pid,syscallnames[num],ret);
     }
   } else {
@@ -28,4 +28,10 @@
 #define SYS_connect  27
 #define SYS_symlink  28
 #define SYS_mmap     29
-#define SYS_munmap    30
\ No newline at end of file
+#define SYS_munmap    30
+#define SYS_fsync     31
+#define SYS_fibmap    32
+#define SYS_pread     33
+#define SYS_pwrite    34
+#define SYS_readv     35
+#define SYS_writev    36
\ No newline at end of file
@@ -104,6 +104,100 @@ uint64 sys_write(void) {
   return filewrite(f, p, n);
 }
 
+// read or write at an offset, leaving the file's own alone.
+uint64 sys_pread(void) {
+  struct file *f;
+  struct iovec iov;
+  uint64 p;
+  int off;
+
+  argaddr(1, &p);
+  iov.base = (void *)p;
+  argint(2, &iov.len);
+  argint(3, &off);
+  if (argfd(0, 0, &f) < 0 || off < 0) return -1;
+  return filereadv(f, &iov, 1, off);
+}
+
+uint64 sys_pwrite(void) {
+  struct file *f;
+  struct iovec iov;
+  uint64 p;
+  int off;
+
+  argaddr(1, &p);
+  iov.base = (void *)p;
+  argint(2, &iov.len);
+  argint(3, &off);
+  if (argfd(0, 0, &f) < 0 || off < 0) return -1;
+  return filewritev(f, &iov, 1, off);
+}
+
+// Fetch the iovec array that is the nth system call argument,
+// with cnt, the number of its entries, the one after it.
+// returns the number of entries, or -1.
+static int argiov(int n, struct iovec *iov) {
+  uint64 uiov;
+  int cnt;
+
+  argaddr(n, &uiov);
+  argint(n + 1, &cnt);
+  if (cnt < 0 || cnt > IOV_MAX) return -1;
+  if (copyin(myproc()->pagetable, (char *)iov, uiov, cnt * sizeof(*iov)) < 0)
+    return -1;
+  for (int i = 0; i < cnt; i++)
+    if (iov[i].len < 0) return -1;
+  return cnt;
+}
+
+uint64 sys_readv(void) {
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int cnt;
+
+  if (argfd(0, 0, &f) < 0 || (cnt = argiov(1, iov)) < 0) return -1;
+  return filereadv(f, iov, cnt, -1);
+}
+
+uint64 sys_writev(void) {
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int cnt;
+
+  if (argfd(0, 0, &f) < 0 || (cnt = argiov(1, iov)) < 0) return -1;
+  return filewritev(f, iov, cnt, -1);
+}
+
+// wait until this process's file system changes are on disk.
+// the log doesn't know which transaction changed which file,
+// so this covers every change the process made, through any
+// descriptor, not just those to f: it waits for the process's
+// last transaction (p->lasttx). f only decides whether its
+// delayed blocks are allocated first.
+uint64 sys_fsync(void) {
+  struct file *f;
+
+  if (argfd(0, 0, &f) < 0) return -1;
+  if (f->type == FD_INODE && f->writable) iflush(f->ip);
+  log_sync();
+  return 0;
+}
+
+// return the disk block holding block bn of an open
+// file, or 0 if it has none (yet).
+uint64 sys_fibmap(void) {
+  struct file *f;
+  int bn;
+  uint addr;
+
+  argint(1, &bn);
+  if (argfd(0, 0, &f) < 0 || f->type != FD_INODE || bn < 0) return -1;
+  ilock_shared(f->ip);
+  addr = ibmap(f->ip, bn);
+  iunlock(f->ip);
+  return addr;
+}
+
 uint64 sys_close(void) {
   int fd;
   struct file *f;
@@ -130,7 +224,7 @@ uint64 sys_link(void) {
 
   if (argstr(0, old, MAXPATH) < 0 || argstr(1, new, MAXPATH) < 0) return -1;
 
-  begin_op();
+  begin_op(DIROPBLOCKS);
   if ((ip = namei(old)) == 0) {
     end_op();
     return -1;
@@ -184,13 +278,12 @@ static int isdirempty(struct inode *dp) {
 
 uint64 sys_unlink(void) {
   struct inode *ip, *dp;
-  struct dirent de;
   char name[DIRSIZ], path[MAXPATH];
   uint off;
 
   if (argstr(0, path, MAXPATH) < 0) return -1;
 
-  begin_op();
+  begin_op(MAXOPBLOCKS);
   if ((dp = nameiparent(path, name)) == 0) {
     end_op();
     return -1;
@@ -210,9 +303,7 @@ uint64 sys_unlink(void) {
     goto bad;
   }
 
-  memset(&de, 0, sizeof(de));
-  if (writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-    panic("unlink: writei");
+  if (dirunlink(dp, name, off) < 0) panic("unlink: writei");
   if (ip->type == T_DIR) {
     dp->nlink--;
     iupdate(dp);
@@ -298,7 +389,7 @@ uint64 sys_open(void) {
   argint(1, &omode);
   if ((n = argstr(0, path, MAXPATH)) < 0) return -1;
 
-  begin_op();
+  begin_op(omode & O_CREATE ? DIROPBLOCKS : MAXOPBLOCKS);
 
   if (omode & O_CREATE) {
     ip = create(path, T_FILE, 0, 0);
@@ -338,6 +429,9 @@ uint64 sys_open(void) {
   } else {
     f->type = FD_INODE;
     f->off = 0;
+    f->ranext = 0;
+    f->raend = 0;
+    f->rawin = 0;
   }
   f->ip = ip;
   f->readable = !(omode & O_WRONLY);
@@ -359,7 +453,7 @@ uint64 sys_symlink(void) {
   if (argstr(0, target, MAXPATH) < 0 || argstr(1, path, MAXPATH) < 0) {
     return -1;
   }
-  begin_op();
+  begin_op(DIROPBLOCKS);
   // target does not need to exist for the system call
   //  just store it in path inode's data block
   if ((ip = namei(target)) != 0 &&
@@ -403,7 +497,7 @@ uint64 sys_mkdir(void) {
   char path[MAXPATH];
   struct inode *ip;
 
-  begin_op();
+  begin_op(DIROPBLOCKS);
   if (argstr(0, path, MAXPATH) < 0 || (ip = create(path, T_DIR, 0, 0)) == 0) {
     end_op();
     return -1;
@@ -418,7 +512,7 @@ uint64 sys_mknod(void) {
   char path[MAXPATH];
   int major, minor;
 
-  begin_op();
+  begin_op(DIROPBLOCKS);
   argint(1, &major);
   argint(2, &minor);
   if ((argstr(0, path, MAXPATH)) < 0 ||
@@ -436,7 +530,7 @@ uint64 sys_chdir(void) {
   struct inode *ip;
   struct proc *p = myproc();
 
-  begin_op();
+  begin_op(MAXOPBLOCKS);
   if (argstr(0, path, MAXPATH) < 0 || (ip = namei(path)) == 0) {
     end_op();
     return -1;
@@ -578,32 +672,6 @@ uint64 sys_mmap(void) {
   return -1;
 }
 
-int file_write_new(struct file *f, uint64 addr,int n ,uint off)
-{
-   int r=0;
-   if(f->writable==0) return -1;
-
-   int max= ((MAXOPBLOCKS-1-1-2) / 2)* BSIZE;
-   int i=0;
-   while(i<n)
-   {
-      int n1=n-i;
-      if(n1>max) n1=max;
-
-      begin_op();
-      ilock(f->ip);
-      if((r=writei(f->ip , 1 , addr +i,off,n1)) >0 )
-          off+=r;
-      iunlock(f->ip);
-      end_op();
-
-      if(r!=n1)  break;
-      i+=r;
-   }
-
-   return 0;
-}
-
 uint64 sys_munmap(void) {
   uint64 addr;
   int len;
@@ -638,7 +706,8 @@ uint64 sys_munmap(void) {
 
       if (v->flags & MAP_SHARED)  // need to write back pages
       {
-        file_write_new(v->f, addr, len, off);
+        struct iovec iov = {(void *)addr, len};
+        filewritev(v->f, &iov, 1, off);
       }
 
       uvmunmap(p->pagetable, PGROUNDDOWN(addr), npages, 0);
@@ -10,6 +10,7 @@ uint64 sys_sysinfo(void){
   struct sysinfo info;
   info.nproc = getactiveprocnum();
   info.freemem = kgetfree();
+  kgetstats(info.kmem);
   if(info.nproc < 0||info.freemem < 0){
     return -1;
   }
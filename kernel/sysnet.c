@@ -27,11 +27,13 @@ struct sock {
 
 static struct spinlock lock;
 static struct sock *sockets;
+static struct kmem_cache *sockcache;
 
 void
 sockinit(void)
 {
   initlock(&lock, "socktbl");
+  sockcache = kmem_cache_create("sock", sizeof(struct sock));
 }
 
 int
@@ -43,7 +45,7 @@ sockalloc(struct file **f, uint32 raddr, uint16 lport, uint16 rport)
   *f = 0;
   if ((*f = filealloc()) == 0)
     goto bad;
-  if ((si = (struct sock*)kalloc()) == 0)
+  if ((si = (struct sock*)kmem_cache_alloc(sockcache)) == 0)
     goto bad;
 
   // initialize objects
@@ -75,8 +77,10 @@ sockalloc(struct file **f, uint32 raddr, uint16 lport, uint16 rport)
   return 0;
 
 bad:
-  if (si)
-    kfree((char*)si);
+  if (si) {
+    freelock(&si->lock);
+    kmem_cache_free(sockcache, si);
+  }
   if (*f)
     fileclose(*f);
   return -1;
@@ -106,7 +110,8 @@ sockclose(struct sock *si)
     mbuffree(m);
   }
 
-  kfree((char*)si);
+  freelock(&si->lock);
+  kmem_cache_free(sockcache, si);
 }
 
 int
@@ -11,11 +11,27 @@ typedef unsigned long uint64;
 
 typedef uint64 pde_t;
 
+#include "param.h"
+
+// per-CPU page allocator counters, see kalloc.c.
+struct kmemstat
+{
+    uint64 hits;    // kalloc()s served from the CPU's own cache
+    uint64 misses;  // kalloc()s that found the cache empty
+    uint64 refills; // batches pulled from the global pool
+    uint64 drains;  // batches pushed back to the global pool
+    uint64 steals;  // pages taken from another CPU's cache
+    uint64 frees;   // pages freed into the cache
+    uint64 cached;  // pages currently in the cache
+    uint64 zhits;   // kalloc_zeroed()s served from the pre-zeroed pool
+    uint64 zmisses; // kalloc_zeroed()s that had to clear a page
+};
 
 struct sysinfo
 {
     uint64 nproc;
     uint64 freemem;
+    struct kmemstat kmem[NCPU];
 };
 #endif
 
@@ -58,6 +58,10 @@ struct virtq_desc {
 };
 #define VRING_DESC_F_NEXT  1 // chained with another descriptor
 #define VRING_DESC_F_WRITE 2 // device writes (vs read)
+#define VRING_DESC_F_INDIRECT 4 // buffer contains a table of descriptors
+
+// most data segments (bufs) in one block request.
+#define NSEG 16
 
 // the (entire) avail ring, from the spec.
 struct virtq_avail {
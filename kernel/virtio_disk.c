@@ -42,14 +42,27 @@ static struct disk {
   char free[NUM];  // is a descriptor free?
   uint16 used_idx; // we've looked this far in used[2..NUM].
 
+  // does the device take indirect descriptor tables? if so
+  // each request occupies a single ring descriptor, which points
+  // at the table in indir[] belonging to that descriptor.
+  int indirect;
+  struct virtq_desc indir[NUM][NSEG+2] __attribute__ ((aligned (16)));
+
   // track info about in-flight operations,
   // for use when completion interrupt arrives.
   // indexed by first descriptor index of chain.
   struct {
-    struct buf *b;
+    struct buf *b[NSEG];  // consecutive blocks, in order
+    int n;
     char status;
+    void (*done)(struct buf *);  // completion callback, or 0
   } info[NUM];
 
+  // completed bufs whose callbacks have yet to run.
+  struct buf *cb[NUM*NSEG];
+  void (*cbfn[NUM*NSEG])(struct buf *);
+  int ncb;
+
   // disk command headers.
   // one-for-one with descriptors, for convenience.
   struct virtio_blk_req ops[NUM];
@@ -91,7 +104,7 @@ virtio_disk_init(void)
   features &= ~(1 << VIRTIO_BLK_F_MQ);
   features &= ~(1 << VIRTIO_F_ANY_LAYOUT);
   features &= ~(1 << VIRTIO_RING_F_EVENT_IDX);
-  features &= ~(1 << VIRTIO_RING_F_INDIRECT_DESC);
+  disk.indirect = (features & (1 << VIRTIO_RING_F_INDIRECT_DESC)) != 0;
   *R(VIRTIO_MMIO_DRIVER_FEATURES) = features;
 
   // tell device that feature negotiation is complete.
@@ -196,12 +209,11 @@ free_chain(int i)
   }
 }
 
-// allocate three descriptors (they need not be contiguous).
-// disk transfers always use three descriptors.
+// allocate n descriptors (they need not be contiguous).
 static int
-alloc3_desc(int *idx)
+alloc_descs(int *idx, int n)
 {
-  for(int i = 0; i < 3; i++){
+  for(int i = 0; i < n; i++){
     idx[i] = alloc_desc();
     if(idx[i] < 0){
       for(int j = 0; j < i; j++)
@@ -212,64 +224,90 @@ alloc3_desc(int *idx)
   return 0;
 }
 
-void
-virtio_disk_rw(struct buf *b, int write)
+// the most data segments one request can carry.
+static int
+maxseg(void)
 {
-  uint64 sector = b->blockno * (BSIZE / 512);
-
-  acquire(&disk.vdisk_lock);
+  return disk.indirect ? NSEG : NUM - 2;
+}
 
-  // the spec's Section 5.2 says that legacy block operations use
-  // three descriptors: one for type/reserved/sector, one for the
-  // data, one for a 1-byte status result.
+// ring descriptors needed for a request with n data segments.
+static int
+ndesc(int n)
+{
+  return disk.indirect ? 1 : n + 2;
+}
 
-  // allocate the three descriptors.
-  int idx[3];
-  while(1){
-    if(alloc3_desc(idx) == 0) {
-      break;
-    }
-    sleep(&disk.free[0], &disk.vdisk_lock);
-  }
+// format a request for the n bufs bs[], which hold consecutive
+// blocks, in the descriptors idx[] and hand it to the device.
+// caller must hold vdisk_lock.
+static void
+submit(struct buf **bs, int n, int write, int *idx, void (*done)(struct buf *))
+{
+  int head = idx[0];
+  struct virtq_desc *d;
+  int slot[NSEG+2];
 
-  // format the three descriptors.
+  // the spec's Section 5.2 says that legacy block operations use
+  // a chain of descriptors: one for type/reserved/sector, one for
+  // each data segment, one for a 1-byte status result.
   // qemu's virtio-blk.c reads them.
 
-  struct virtio_blk_req *buf0 = &disk.ops[idx[0]];
+  struct virtio_blk_req *buf0 = &disk.ops[head];
 
   if(write)
     buf0->type = VIRTIO_BLK_T_OUT; // write the disk
   else
     buf0->type = VIRTIO_BLK_T_IN; // read the disk
   buf0->reserved = 0;
-  buf0->sector = sector;
-
-  disk.desc[idx[0]].addr = (uint64) buf0;
-  disk.desc[idx[0]].len = sizeof(struct virtio_blk_req);
-  disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
-  disk.desc[idx[0]].next = idx[1];
+  buf0->sector = bs[0]->blockno * (BSIZE / 512);
+
+  if(disk.indirect){
+    // the chain lives in head's indirect table.
+    d = disk.indir[head];
+    for(int i = 0; i < n + 2; i++)
+      slot[i] = i;
+    disk.desc[head].addr = (uint64) d;
+    disk.desc[head].len = (n + 2) * sizeof(struct virtq_desc);
+    disk.desc[head].flags = VRING_DESC_F_INDIRECT;
+    disk.desc[head].next = 0;
+  } else {
+    d = disk.desc;
+    for(int i = 0; i < n + 2; i++)
+      slot[i] = idx[i];
+  }
 
-  disk.desc[idx[1]].addr = (uint64) b->data;
-  disk.desc[idx[1]].len = BSIZE;
-  if(write)
-    disk.desc[idx[1]].flags = 0; // device reads b->data
-  else
-    disk.desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes b->data
-  disk.desc[idx[1]].flags |= VRING_DESC_F_NEXT;
-  disk.desc[idx[1]].next = idx[2];
+  d[slot[0]].addr = (uint64) buf0;
+  d[slot[0]].len = sizeof(struct virtio_blk_req);
+  d[slot[0]].flags = VRING_DESC_F_NEXT;
+  d[slot[0]].next = slot[1];
+
+  for(int i = 0; i < n; i++){
+    struct virtq_desc *dd = &d[slot[1+i]];
+    dd->addr = (uint64) bs[i]->data;
+    dd->len = BSIZE;
+    if(write)
+      dd->flags = 0; // device reads b->data
+    else
+      dd->flags = VRING_DESC_F_WRITE; // device writes b->data
+    dd->flags |= VRING_DESC_F_NEXT;
+    dd->next = slot[2+i];
 
-  disk.info[idx[0]].status = 0xff; // device writes 0 on success
-  disk.desc[idx[2]].addr = (uint64) &disk.info[idx[0]].status;
-  disk.desc[idx[2]].len = 1;
-  disk.desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
-  disk.desc[idx[2]].next = 0;
+    // record struct buf for virtio_disk_intr().
+    bs[i]->disk = 1;
+    disk.info[head].b[i] = bs[i];
+  }
+  disk.info[head].n = n;
+  disk.info[head].done = done;
 
-  // record struct buf for virtio_disk_intr().
-  b->disk = 1;
-  disk.info[idx[0]].b = b;
+  disk.info[head].status = 0xff; // device writes 0 on success
+  d[slot[n+1]].addr = (uint64) &disk.info[head].status;
+  d[slot[n+1]].len = 1;
+  d[slot[n+1]].flags = VRING_DESC_F_WRITE; // device writes the status
+  d[slot[n+1]].next = 0;
 
   // tell the device the first index in our chain of descriptors.
-  disk.avail->ring[disk.avail->idx % NUM] = idx[0];
+  disk.avail->ring[disk.avail->idx % NUM] = head;
 
   __sync_synchronize();
 
@@ -279,18 +317,82 @@ virtio_disk_rw(struct buf *b, int write)
   __sync_synchronize();
 
   *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+}
 
-  // Wait for virtio_disk_intr() to say request has finished.
-  while(b->disk == 1) {
-    sleep(b, &disk.vdisk_lock);
+// requests are asynchronous: virtio_disk_submit() hands b to
+// the device and returns. when the device is done, the interrupt
+// handler calls done(b) if done is set; otherwise the caller
+// must collect the request with virtio_disk_wait(b). b must
+// stay locked until then.
+
+// start a transfer of the n bufs bs[], which must hold
+// consecutive blocks, in as few requests as possible.
+// waits only for free descriptors.
+void
+virtio_disk_submitv(struct buf **bs, int n, int write, void (*done)(struct buf *))
+{
+  int idx[NUM];
+
+  for(int i = 1; i < n; i++)
+    if(bs[i]->blockno != bs[0]->blockno + i || bs[i]->dev != bs[0]->dev)
+      panic("virtio_disk_submitv");
+
+  acquire(&disk.vdisk_lock);
+  while(n > 0){
+    int m = n < maxseg() ? n : maxseg();
+    while(alloc_descs(idx, ndesc(m)) != 0)
+      sleep(&disk.free[0], &disk.vdisk_lock);
+    submit(bs, m, write, idx, done);
+    bs += m;
+    n -= m;
   }
+  release(&disk.vdisk_lock);
+}
+
+// start a transfer of b, waiting only for free descriptors.
+void
+virtio_disk_submit(struct buf *b, int write, void (*done)(struct buf *))
+{
+  virtio_disk_submitv(&b, 1, write, done);
+}
 
-  disk.info[idx[0]].b = 0;
-  free_chain(idx[0]);
+// start one request for as many of the n bufs bs[] as fit in
+// it, and return how many that was. if no descriptors are
+// free, start nothing and return -1.
+int
+virtio_disk_trysubmitv(struct buf **bs, int n, int write, void (*done)(struct buf *))
+{
+  int idx[NUM];
+
+  if(n > maxseg())
+    n = maxseg();
+  acquire(&disk.vdisk_lock);
+  if(alloc_descs(idx, ndesc(n)) < 0){
+    release(&disk.vdisk_lock);
+    return -1;
+  }
+  submit(bs, n, write, idx, done);
+  release(&disk.vdisk_lock);
+  return n;
+}
 
+// wait for a request submitted without a callback to finish.
+void
+virtio_disk_wait(struct buf *b)
+{
+  acquire(&disk.vdisk_lock);
+  while(b->disk == 1)
+    sleep(b, &disk.vdisk_lock);
   release(&disk.vdisk_lock);
 }
 
+void
+virtio_disk_rw(struct buf *b, int write)
+{
+  virtio_disk_submit(b, write, 0);
+  virtio_disk_wait(b);
+}
+
 void
 virtio_disk_intr()
 {
@@ -316,12 +418,33 @@ virtio_disk_intr()
     if(disk.info[id].status != 0)
       panic("virtio_disk_intr status");
 
-    struct buf *b = disk.info[id].b;
-    b->disk = 0;   // disk is done with buf
-    wakeup(b);
+    for(int i = 0; i < disk.info[id].n; i++){
+      struct buf *b = disk.info[id].b[i];
+      disk.info[id].b[i] = 0;
+      b->disk = 0;   // disk is done with buf
+      if(disk.info[id].done){
+        disk.cb[disk.ncb] = b;
+        disk.cbfn[disk.ncb++] = disk.info[id].done;
+      } else {
+        wakeup(b);
+      }
+    }
+    disk.info[id].n = 0;
+    free_chain(id);
 
     disk.used_idx += 1;
   }
 
+  // callbacks may take other locks, so run them
+  // without holding vdisk_lock.
+  while(disk.ncb > 0){
+    int i = --disk.ncb;
+    struct buf *b = disk.cb[i];
+    void (*fn)(struct buf *) = disk.cbfn[i];
+    release(&disk.vdisk_lock);
+    fn(b);
+    acquire(&disk.vdisk_lock);
+  }
+
   release(&disk.vdisk_lock);
 }
@@ -106,9 +106,8 @@ walk(pagetable_t pagetable, uint64 va, int alloc)
     if(*pte & PTE_V) {
       pagetable = (pagetable_t)PTE2PA(*pte);
     } else {
-      if(!alloc || (pagetable = (pde_t*)kalloc()) == 0)
+      if(!alloc || (pagetable = (pde_t*)kalloc_zeroed()) == 0)
         return 0;
-      memset(pagetable, 0, PGSIZE);
       *pte = PA2PTE(pagetable) | PTE_V;
     }
   }
@@ -217,12 +216,7 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 pagetable_t
 uvmcreate()
 {
-  pagetable_t pagetable;
-  pagetable = (pagetable_t) kalloc();
-  if(pagetable == 0)
-    return 0;
-  memset(pagetable, 0, PGSIZE);
-  return pagetable;
+  return (pagetable_t) kalloc_zeroed();
 }
 
 // Load the user initcode into address 0 of pagetable,
@@ -235,8 +229,7 @@ uvmfirst(pagetable_t pagetable, uchar *src, uint sz)
 
   if(sz >= PGSIZE)
     panic("uvmfirst: more than a page");
-  mem = kalloc();
-  memset(mem, 0, PGSIZE);
+  mem = kalloc_zeroed();
   mappages(pagetable, 0, PGSIZE, (uint64)mem, PTE_W|PTE_R|PTE_X|PTE_U);
   memmove(mem, src, sz);
 }
@@ -254,12 +247,11 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz, int xperm)
 
   oldsz = PGROUNDUP(oldsz);
   for(a = oldsz; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    mem = kalloc_zeroed();
     if(mem == 0){
       uvmdealloc(pagetable, a, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
     if(mappages(pagetable, a, PGSIZE, (uint64)mem, PTE_R|PTE_U|xperm) != 0){
       kfree(mem);
       uvmdealloc(pagetable, a, oldsz);
@@ -541,15 +533,14 @@ int do_lazymmap(struct proc* p,uint64 va,int fault_flag){
     if(pte==0){
       return 1;
     }
-    void* mem=kalloc();
+    void* mem=kalloc_zeroed();
     if(mem==0){
       return 1;
     }
-    memset(mem,0,PGSIZE);
     va=PGROUNDDOWN(va);
     uint64 off=vma->start_point+va-vma->addr;
     *pte=PAFLAGS2PTE(mem, vma->prot<<1|PTE_V|PTE_U);
-    ilock(vma->f->ip);
+    ilock_shared(vma->f->ip);
     readi(vma->f->ip,1,va,off,PGSIZE);
     iunlock(vma->f->ip);
     return 0;
@@ -570,11 +561,22 @@ int docow(pagetable_t pt, uint64 va){
     return -1;
   }
   if((flags & PTE_COW) && ((flags & PTE_W) ==0) && (flags & PTE_PW)){
+      flags = (flags & (~PTE_COW) & (~PTE_PW)) | PTE_W;
+      // the other sharers are gone; take the page over
+      // instead of copying it.
+      if(kgetref((void*)pa) == 1){
+        *pte = PAFLAGS2PTE(pa,flags);
+        sfence_vma();
+        return 0;
+      }
       void* mem = kalloc();
+      if(mem == 0){
+        return -1;
+      }
       memmove(mem,(void*)pa,PGSIZE);
       kfree((void*)pa);
-      flags = (flags & (~PTE_COW) & (~PTE_PW)) | PTE_W;
       *pte = PAFLAGS2PTE(mem,flags);
+      sfence_vma();
       return 0;
   }
   return -1;
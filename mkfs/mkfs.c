@@ -15,14 +15,16 @@
 #define static_assert(a, b) do { switch (0) case 0: case (a): ; } while (0)
 #endif
 
-#define NINODES 8000
+#define NINODES 16000
+#define NROOT 1024   // most entries in the root directory
 
 // Disk layout:
 // [ boot block | sb block | log | inode blocks | free bit map | data blocks ]
 
 int nbitmap = FSSIZE/(BSIZE*8) + 1;
 int ninodeblocks = NINODES / IPB + 1;
-int nlog = LOGSIZE;
+int nlog = LOGBLOCKS;
+uint sbflags;
 int nmeta;    // Number of meta blocks (boot, sb, nlog, inode, bitmap)
 int nblocks;  // Number of data blocks
 
@@ -40,6 +42,7 @@ void rinode(uint inum, struct dinode *ip);
 void rsect(uint sec, void *buf);
 uint ialloc(ushort type);
 void iappend(uint inum, void *p, int n);
+void wdir(uint inum, struct dirent *ents, int n);
 void die(const char *);
 
 // convert to riscv byte order
@@ -70,15 +73,34 @@ main(int argc, char *argv[])
 {
   int i, cc, fd;
   uint rootino, inum, off;
-  struct dirent de;
+  static struct dirent root[NROOT];
+  int nroot = 0;
   char buf[BSIZE];
   struct dinode din;
 
 
   static_assert(sizeof(int) == 4, "Integers must be 4 bytes!");
-
+  static_assert(EXTBLK < NDIRECT+NINDIRECT+NDINDIRECT, "Extents must fit in addrs[]");
+
+  for(;;){
+    if(argc > 2 && strcmp(argv[1], "-l") == 0){
+      nlog = atoi(argv[2]);
+      argc -= 2;
+      argv += 2;
+    } else if(argc > 1 && strcmp(argv[1], "-o") == 0){
+      // ordered data: the kernel logs only metadata.
+      sbflags |= SB_ORDERED;
+      argc--;
+      argv++;
+    } else
+      break;
+  }
   if(argc < 2){
-    fprintf(stderr, "Usage: mkfs fs.img files...\n");
+    fprintf(stderr, "Usage: mkfs [-l logblocks] [-o] fs.img files...\n");
+    exit(1);
+  }
+  if(nlog < 4*DELAYOPBLOCKS+1){
+    fprintf(stderr, "mkfs: log must be at least %d blocks\n", 4*DELAYOPBLOCKS+1);
     exit(1);
   }
 
@@ -101,6 +123,7 @@ main(int argc, char *argv[])
   sb.logstart = xint(2);
   sb.inodestart = xint(2+nlog);
   sb.bmapstart = xint(2+nlog+ninodeblocks);
+  sb.flags = xint(sbflags);
 
   printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d\n",
          nmeta, nlog, ninodeblocks, nbitmap, nblocks, FSSIZE);
@@ -117,15 +140,10 @@ main(int argc, char *argv[])
   rootino = ialloc(T_DIR);
   assert(rootino == ROOTINO);
 
-  bzero(&de, sizeof(de));
-  de.inum = xshort(rootino);
-  strcpy(de.name, ".");
-  iappend(rootino, &de, sizeof(de));
-
-  bzero(&de, sizeof(de));
-  de.inum = xshort(rootino);
-  strcpy(de.name, "..");
-  iappend(rootino, &de, sizeof(de));
+  root[nroot].inum = xshort(rootino);
+  strcpy(root[nroot++].name, ".");
+  root[nroot].inum = xshort(rootino);
+  strcpy(root[nroot++].name, "..");
 
   for(i = 2; i < argc; i++){
     // get rid of "user/"
@@ -149,10 +167,9 @@ main(int argc, char *argv[])
 
     inum = ialloc(T_FILE);
 
-    bzero(&de, sizeof(de));
-    de.inum = xshort(inum);
-    strncpy(de.name, shortname, DIRSIZ);
-    iappend(rootino, &de, sizeof(de));
+    assert(nroot < NROOT);
+    root[nroot].inum = xshort(inum);
+    strncpy(root[nroot++].name, shortname, DIRSIZ);
 
     while((cc = read(fd, buf, sizeof(buf))) > 0)
       iappend(inum, buf, cc);
@@ -160,10 +177,12 @@ main(int argc, char *argv[])
     close(fd);
   }
 
+  wdir(rootino, root, nroot);
+
   // fix size of root inode dir
   rinode(rootino, &din);
   off = xint(din.size);
-  off = ((off/BSIZE) + 1) * BSIZE;
+  off = (off + BSIZE - 1) / BSIZE * BSIZE;
   din.size = xint(off);
   winode(rootino, &din);
 
@@ -224,6 +243,8 @@ ialloc(ushort type)
   struct dinode din;
 
   bzero(&din, sizeof(din));
+  if(type == T_FILE)
+    type |= DI_EXTENTS;  // regular files are mapped by extents
   din.type = xshort(type);
   din.nlink = xshort(1);
   din.size = xint(0);
@@ -247,8 +268,88 @@ balloc(int used)
   wsect(sb.bmapstart, buf);
 }
 
+// Write the n entries of directory inum, the first two of
+// which are "." and "..": in order if they fit in one block,
+// and otherwise hashed, with as many blocks of entries as it
+// takes for each to fit.
+void
+wdir(uint inum, struct dirent *ents, int n)
+{
+  char blk[BSIZE], tab[2][BSIZE];
+  int i, nb, fits, *cnt;
+  struct dirent *de;
+  struct dinode din;
+
+  if(n * sizeof(struct dirent) <= BSIZE){
+    iappend(inum, ents, n * sizeof(struct dirent));
+    return;
+  }
+
+  for(nb = 2; ; nb *= 2){
+    assert(nb <= DIRTAB);
+    cnt = calloc(nb, sizeof(int));
+    fits = 1;
+    for(i = 2; i < n; i++)
+      if(++cnt[dirhash(ents[i].name) % nb] > BSIZE / sizeof(struct dirent))
+        fits = 0;
+    free(cnt);
+    if(fits)
+      break;
+  }
+
+  bzero(blk, BSIZE);
+  memmove(blk, ents, 2 * sizeof(struct dirent));
+  iappend(inum, blk, BSIZE);
+
+  // table entry i is the i%7'th short in the name of a dirent.
+  bzero(tab, sizeof(tab));
+  for(i = 0; i < DIRTAB; i++){
+    de = (struct dirent*)tab[i / DIRTABPB] + i % DIRTABPB / 7;
+    ((ushort*)de->name)[i % 7] = xshort(DIRBUCKET + i % nb);
+  }
+  iappend(inum, tab, sizeof(tab));
+
+  for(int b = 0; b < nb; b++){
+    bzero(blk, BSIZE);
+    de = (struct dirent*)blk;
+    for(i = 2; i < n; i++)
+      if(dirhash(ents[i].name) % nb == b)
+        *de++ = ents[i];
+    iappend(inum, blk, BSIZE);
+  }
+
+  rinode(inum, &din);
+  din.type = xshort(xshort(din.type) | DI_HASHED);
+  winode(inum, &din);
+}
+
 #define min(a, b) ((a) < (b) ? (a) : (b))
 
+// Return the disk block of block fbn of an inode with extents,
+// appending a block if fbn is the first one past the end. Files
+// are written one at a time, so the last extent usually grows.
+uint
+ebmap(struct dinode *din, uint fbn)
+{
+  struct extent *x = (struct extent*)din->addrs;
+  int i;
+
+  for(i = 0; i < NEXTENT && xint(x[i].len) != 0; i++){
+    if(fbn < xint(x[i].len))
+      return xint(x[i].start) + fbn;
+    fbn -= xint(x[i].len);
+  }
+  assert(fbn == 0);
+  if(i > 0 && xint(x[i-1].start) + xint(x[i-1].len) == freeblock){
+    x[i-1].len = xint(xint(x[i-1].len) + 1);
+  } else {
+    assert(i < NEXTENT);
+    x[i].start = xint(freeblock);
+    x[i].len = xint(1);
+  }
+  return freeblock++;
+}
+
 void
 iappend(uint inum, void *xp, int n)
 {
@@ -266,7 +367,9 @@ iappend(uint inum, void *xp, int n)
   while(n > 0){
     fbn = off / BSIZE;
     assert(fbn < MAXFILE);
-    if(fbn < NDIRECT){
+    if(xshort(din.type) & DI_EXTENTS){
+      x = ebmap(&din, fbn);
+    } else if(fbn < NDIRECT){
       if(xint(din.addrs[fbn]) == 0){
         din.addrs[fbn] = xint(freeblock++);
       }
@@ -0,0 +1,115 @@
+//
+// buffer cache benchmark: several processes read their own
+// small file over and over in parallel. every read looks the
+// file's blocks up in the buffer cache, so the run measures
+// bcache lock contention, taken from the test-and-set counts
+// that acquire() keeps for the statistics device.
+//
+
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define NCHILD 4
+#define NBLOCK 64
+#define ROUNDS 40
+#define BSIZE 1024
+
+char buf[BSIZE];
+char report[8192];
+
+// total test-and-set spins on kmem and bcache locks so far.
+int
+ntas(void)
+{
+  int n = statistics(report, sizeof(report) - 1);
+  if(n < 0)
+    exit(1);
+  report[n] = 0;
+  for(char *p = report; *p; p++){
+    if(p[0] == 't' && p[1] == 'o' && p[2] == 't' && p[3] == '=')
+      return atoi(p + 5);
+  }
+  printf("bcachetest: no tot= in statistics\n");
+  exit(1);
+}
+
+void
+createfile(char *name)
+{
+  int fd = open(name, O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf("bcachetest: create %s failed\n", name);
+    exit(1);
+  }
+  for(int i = 0; i < NBLOCK; i++){
+    memset(buf, i, BSIZE);
+    if(write(fd, buf, BSIZE) != BSIZE){
+      printf("bcachetest: write %s failed\n", name);
+      exit(1);
+    }
+  }
+  close(fd);
+}
+
+void
+readfile(char *name)
+{
+  for(int r = 0; r < ROUNDS; r++){
+    int fd = open(name, O_RDONLY);
+    if(fd < 0){
+      printf("bcachetest: open %s failed\n", name);
+      exit(1);
+    }
+    for(int i = 0; i < NBLOCK; i++){
+      if(read(fd, buf, BSIZE) != BSIZE || buf[0] != (char)i){
+        printf("bcachetest: read %s failed\n", name);
+        exit(1);
+      }
+    }
+    close(fd);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  char name[] = "bcachefile0";
+
+  for(int i = 0; i < NCHILD; i++){
+    name[10] = '0' + i;
+    createfile(name);
+  }
+
+  int m = ntas();
+  int start = uptime();
+  for(int i = 0; i < NCHILD; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("bcachetest: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      name[10] = '0' + i;
+      readfile(name);
+      exit(0);
+    }
+  }
+  for(int i = 0; i < NCHILD; i++){
+    int status;
+    wait(&status);
+    if(status != 0)
+      exit(1);
+  }
+  int t = uptime() - start;
+  int n = ntas() - m;
+
+  printf("bcachetest: %d processes read %d blocks each in %d ticks\n",
+         NCHILD, NBLOCK * ROUNDS, t);
+  printf("bcachetest: %d test-and-sets on kmem/bcache locks\n", n);
+  for(int i = 0; i < NCHILD; i++){
+    name[10] = '0' + i;
+    unlink(name);
+  }
+  exit(0);
+}
@@ -4,11 +4,20 @@
 #include "kernel/fcntl.h"
 #include "kernel/fs.h"
 
+// bigfile [n] writes n blocks per write() (default 1), and
+// reports how long writing and reading took.
 int
-main()
+main(int argc, char *argv[])
 {
-  char buf[BSIZE];
-  int fd, i, blocks;
+  char *buf;
+  int fd, i, blocks, n = 1, t;
+
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(n < 1 || (buf = malloc(n * BSIZE)) == 0){
+    printf("bigfile: bad block count\n");
+    exit(-1);
+  }
 
   fd = open("big.file", O_CREATE | O_WRONLY);
   if(fd < 0){
@@ -16,18 +25,23 @@ main()
     exit(-1);
   }
 
+  t = uptime();
   blocks = 0;
   while(1){
-    *(int*)buf = blocks;
-    int cc = write(fd, buf, sizeof(buf));
+    for(i = 0; i < n; i++)
+      *(int*)(buf + i*BSIZE) = blocks + i;
+    // a write that runs out of room fails, though it may
+    // have written some of its blocks.
+    int cc = write(fd, buf, n * BSIZE);
     if(cc <= 0)
       break;
-    blocks++;
-    if (blocks % 100 == 0)
+    blocks += n;
+    if (blocks % 100 < n)
       printf(".");
   }
+  t = uptime() - t;
 
-  printf("\nwrote %d blocks\n", blocks);
+  printf("\nwrote %d blocks in %d ticks\n", blocks, t);
   if(blocks < 65803) {
     printf("bigfile: file is too small\n");
     exit(-1);
@@ -39,8 +53,9 @@ main()
     printf("bigfile: cannot re-open big.file for reading\n");
     exit(-1);
   }
+  t = uptime();
   for(i = 0; i < blocks; i++){
-    int cc = read(fd, buf, sizeof(buf));
+    int cc = read(fd, buf, BSIZE);
     if(cc <= 0){
       printf("bigfile: read error at block %d\n", i);
       exit(-1);
@@ -52,6 +67,7 @@ main()
     }
   }
 
+  printf("read %d blocks in %d ticks\n", blocks, uptime() - t);
   printf("bigfile done; ok\n"); 
 
   exit(0);
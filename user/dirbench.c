@@ -0,0 +1,92 @@
+//
+// large directory benchmark: create n files (default 10000)
+// in one new directory, stat each of them, then remove them.
+// with a linear directory every lookup reads the directory
+// up to the entry, so each phase takes time quadratic in n;
+// hashed directories read one block per lookup.
+//
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define DIR "dirbench.d"
+
+char path[32];
+
+// set path to the name of file i.
+void
+name(int i)
+{
+  char num[12];
+  int n = 0;
+
+  do {
+    num[n++] = '0' + i % 10;
+    i /= 10;
+  } while(i > 0);
+  strcpy(path, DIR "/f");
+  for(int j = strlen(path); n > 0; j++){
+    path[j] = num[--n];
+    path[j+1] = 0;
+  }
+}
+
+void
+report(char *what, int n, int t)
+{
+  printf("dirbench: %s %d files: %d ticks, %d files/100 ticks\n",
+         what, n, t, t > 0 ? (n * 100) / t : 0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n = 10000, fd, t;
+  struct stat st;
+
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(mkdir(DIR) < 0){
+    printf("dirbench: mkdir %s failed\n", DIR);
+    exit(1);
+  }
+
+  t = uptime();
+  for(int i = 0; i < n; i++){
+    name(i);
+    if((fd = open(path, O_CREATE | O_WRONLY)) < 0){
+      printf("dirbench: create %s failed\n", path);
+      exit(1);
+    }
+    close(fd);
+  }
+  report("create", n, uptime() - t);
+
+  t = uptime();
+  for(int i = 0; i < n; i++){
+    name(i);
+    if(stat(path, &st) < 0 || st.type != T_FILE){
+      printf("dirbench: stat %s failed\n", path);
+      exit(1);
+    }
+  }
+  report("stat", n, uptime() - t);
+
+  t = uptime();
+  for(int i = 0; i < n; i++){
+    name(i);
+    if(unlink(path) < 0){
+      printf("dirbench: unlink %s failed\n", path);
+      exit(1);
+    }
+  }
+  report("unlink", n, uptime() - t);
+
+  if(unlink(DIR) < 0){
+    printf("dirbench: unlink %s failed\n", DIR);
+    exit(1);
+  }
+  exit(0);
+}
@@ -0,0 +1,83 @@
+//
+// fork scaling benchmark: several workers, each with a large
+// heap, fork in parallel. every fork shares the whole heap
+// copy-on-write (uvmcopy) and the child then breaks COW on a
+// few pages (docow), so the run time is dominated by page
+// reference count traffic.
+//
+
+#include "kernel/types.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+#define HEAPPAGES 512
+#define FORKS 50
+#define TOUCH 8
+
+void
+worker(void)
+{
+  char *heap = sbrk(HEAPPAGES * PGSIZE);
+  if(heap == (char*)0xffffffffffffffffL){
+    printf("forkbench: sbrk failed\n");
+    exit(1);
+  }
+  for(int i = 0; i < HEAPPAGES; i++)
+    heap[i * PGSIZE] = i;
+
+  for(int i = 0; i < FORKS; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("forkbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      for(int j = 0; j < TOUCH; j++)
+        heap[j * (HEAPPAGES / TOUCH) * PGSIZE] = j;
+      exit(0);
+    }
+    wait(0);
+  }
+  exit(0);
+}
+
+// run nworkers workers at once; return elapsed ticks.
+int
+run(int nworkers)
+{
+  int start = uptime();
+
+  for(int i = 0; i < nworkers; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("forkbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0)
+      worker();
+  }
+  for(int i = 0; i < nworkers; i++){
+    int status;
+    wait(&status);
+    if(status != 0)
+      exit(1);
+  }
+  return uptime() - start;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int max = 4;
+
+  if(argc > 1)
+    max = atoi(argv[1]);
+  printf("forkbench: %d forks of a %d page heap per worker\n",
+         FORKS, HEAPPAGES);
+  for(int n = 1; n <= max; n *= 2){
+    int t = run(n);
+    printf("workers %d: %d ticks, %d forks/100 ticks\n",
+           n, t, t > 0 ? (n * FORKS * 100) / t : 0);
+  }
+  exit(0);
+}
@@ -0,0 +1,172 @@
+//
+// fragmentation report: walk the block map of each regular
+// file under the given paths (default .) with fibmap(), and
+// count its fragments, the runs of consecutive disk blocks.
+// a file in one run isn't fragmented.
+//
+// frag -w first has several processes append to their own
+// files a block at a time, interleaved, then reports on
+// those files and removes them.
+//
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/fs.h"
+#include "user/user.h"
+
+#define NWRITER 4
+#define NBLOCK 200
+
+int vflag;
+int nfiles, nfragged;
+int nblocks, nfrags;
+
+// report on one open regular file.
+void
+fragfile(char *path, int fd, struct stat *st)
+{
+  int n = (st->size + BSIZE - 1) / BSIZE;
+  int frags = 0;
+  uint prev = 0, b;
+
+  for(int bn = 0; bn < n; bn++){
+    b = fibmap(fd, bn);
+    if(b == 0 || b == (uint)-1){
+      fprintf(2, "frag: %s: no block %d\n", path, bn);
+      break;
+    }
+    if(bn == 0 || b != prev + 1)
+      frags++;
+    prev = b;
+  }
+  nfiles++;
+  nblocks += n;
+  nfrags += frags;
+  if(frags > 1)
+    nfragged++;
+  if(vflag)
+    printf("%s: %d blocks, %d fragments\n", path, n, frags);
+}
+
+void
+frag(char *path)
+{
+  char buf[512], *p;
+  int fd;
+  struct dirent de;
+  struct stat st;
+
+  if((fd = open(path, O_RDONLY)) < 0){
+    fprintf(2, "frag: cannot open %s\n", path);
+    return;
+  }
+  if(fstat(fd, &st) < 0){
+    fprintf(2, "frag: cannot stat %s\n", path);
+    close(fd);
+    return;
+  }
+
+  switch(st.type){
+  case T_FILE:
+    fragfile(path, fd, &st);
+    break;
+
+  case T_DIR:
+    if(strlen(path) + 1 + DIRSIZ + 1 > sizeof buf){
+      fprintf(2, "frag: path too long\n");
+      break;
+    }
+    strcpy(buf, path);
+    p = buf+strlen(buf);
+    *p++ = '/';
+    while(read(fd, &de, sizeof(de)) == sizeof(de)){
+      if(de.inum == 0 || strcmp(de.name, ".") == 0 || strcmp(de.name, "..") == 0)
+        continue;
+      memmove(p, de.name, DIRSIZ);
+      p[DIRSIZ] = 0;
+      frag(buf);
+    }
+    break;
+  }
+  close(fd);
+}
+
+// NWRITER processes each append NBLOCK blocks to their own
+// file, one block per write().
+void
+writefiles(void)
+{
+  char name[] = "fragfile0";
+  char data[BSIZE];
+
+  memset(data, 'f', sizeof(data));
+  for(int i = 0; i < NWRITER; i++){
+    name[8] = '0' + i;
+    int pid = fork();
+    if(pid < 0){
+      fprintf(2, "frag: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      int fd = open(name, O_CREATE | O_TRUNC | O_WRONLY);
+      if(fd < 0){
+        fprintf(2, "frag: cannot create %s\n", name);
+        exit(1);
+      }
+      for(int j = 0; j < NBLOCK; j++){
+        if(write(fd, data, sizeof(data)) != sizeof(data)){
+          fprintf(2, "frag: write failed\n");
+          exit(1);
+        }
+      }
+      close(fd);
+      exit(0);
+    }
+  }
+  for(int i = 0; i < NWRITER; i++){
+    int status;
+    wait(&status);
+    if(status != 0)
+      exit(1);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, wflag = 0;
+  char name[] = "fragfile0";
+
+  for(i = 1; i < argc && argv[i][0] == '-'; i++){
+    if(strcmp(argv[i], "-v") == 0)
+      vflag = 1;
+    else if(strcmp(argv[i], "-w") == 0)
+      wflag = 1;
+    else {
+      fprintf(2, "usage: frag [-v] [-w] [path...]\n");
+      exit(1);
+    }
+  }
+
+  if(wflag){
+    writefiles();
+    for(int j = 0; j < NWRITER; j++){
+      name[8] = '0' + j;
+      frag(name);
+      unlink(name);
+    }
+  } else if(i == argc){
+    frag(".");
+  } else {
+    for(; i < argc; i++)
+      frag(argv[i]);
+  }
+
+  printf("frag: %d files, %d blocks, %d fragments, %d files fragmented",
+         nfiles, nblocks, nfrags, nfragged);
+  if(nfrags > 0)
+    printf(", %d blocks/fragment", nblocks / nfrags);
+  printf("\n");
+  exit(0);
+}
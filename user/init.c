@@ -23,6 +23,8 @@ main(void)
   dup(0);  // stdout
   dup(0);  // stderr
 
+  mknod("statistics", STATS, 0);  // fails if it exists already
+
   for(;;){
     printf("init: starting sh\n");
     pid = fork();
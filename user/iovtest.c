@@ -0,0 +1,160 @@
+//
+// tests for pread, pwrite, readv and writev.
+//
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/fs.h"
+#include "user/user.h"
+
+#define fail(msg) do {printf("FAILURE: " msg "\n"); failed = 1; goto done;} while (0);
+static int failed = 0;
+
+#define FILE "iovtest.f"
+#define NIOV 5
+
+char data[8*BSIZE];
+char got[8*BSIZE];
+
+static void
+fill(char *p, int n, int seed)
+{
+  for(int i = 0; i < n; i++)
+    p[i] = 'a' + (i * 7 + seed) % 26;
+}
+
+// pwrite and pread at offsets leave the file offset alone.
+static void
+testpos(void)
+{
+  int fd;
+
+  printf("start: pread/pwrite\n");
+  if((fd = open(FILE, O_CREATE | O_TRUNC | O_RDWR)) < 0)
+    fail("create");
+  fill(data, sizeof(data), 0);
+  if(write(fd, data, 3*BSIZE) != 3*BSIZE)
+    fail("write");
+
+  // overwrite across a block boundary, then append.
+  fill(data + BSIZE - 10, 100, 1);
+  if(pwrite(fd, data + BSIZE - 10, 100, BSIZE - 10) != 100)
+    fail("pwrite");
+  fill(data + 3*BSIZE, 2*BSIZE, 2);
+  if(pwrite(fd, data + 3*BSIZE, 2*BSIZE, 3*BSIZE) != 2*BSIZE)
+    fail("pwrite append");
+  if(pwrite(fd, data, 10, 6*BSIZE) >= 0)
+    fail("pwrite past the end");
+
+  memset(got, 0, sizeof(got));
+  if(pread(fd, got, 5*BSIZE, 0) != 5*BSIZE)
+    fail("pread");
+  if(memcmp(got, data, 5*BSIZE) != 0)
+    fail("pread data");
+  if(pread(fd, got, 100, 5*BSIZE - 50) != 50)
+    fail("pread at the end");
+  if(pread(fd, got, 100, 5*BSIZE + 1) != 0)
+    fail("pread past the end");
+
+  // the offset is still where write() left it.
+  if(read(fd, got, BSIZE) != BSIZE || memcmp(got, data + 3*BSIZE, BSIZE) != 0)
+    fail("offset moved");
+
+  printf("test pread/pwrite: OK\n");
+done:
+  close(fd);
+  unlink(FILE);
+}
+
+// writev writes the buffers back to back; readv reads them
+// back the same way, and both advance the offset.
+static void
+testvec(void)
+{
+  struct iovec iov[NIOV];
+  int len[NIOV] = { 10, BSIZE, 0, 3*BSIZE + 7, 500 };
+  int fd, tot = 0;
+
+  printf("start: readv/writev\n");
+  if((fd = open(FILE, O_CREATE | O_TRUNC | O_RDWR)) < 0)
+    fail("create");
+  fill(data, sizeof(data), 3);
+  for(int i = 0; i < NIOV; i++){
+    iov[i].base = data + tot;
+    iov[i].len = len[i];
+    tot += len[i];
+  }
+  if(writev(fd, iov, NIOV) != tot)
+    fail("writev");
+  if(writev(fd, iov, NIOV) != tot)
+    fail("second writev");
+  close(fd);
+
+  if((fd = open(FILE, O_RDONLY)) < 0)
+    fail("open");
+  memset(got, 0, sizeof(got));
+  for(int i = 0, off = 0; i < NIOV; i++){
+    iov[i].base = got + off;
+    iov[i].len = len[i];
+    off += len[i];
+  }
+  for(int pass = 0; pass < 2; pass++){
+    if(readv(fd, iov, NIOV) != tot)
+      fail("readv");
+    if(memcmp(got, data, tot) != 0)
+      fail("readv data");
+  }
+  if(readv(fd, iov, NIOV) != 0)
+    fail("readv at the end");
+
+  iov[0].len = -1;
+  if(readv(fd, iov, 1) >= 0)
+    fail("negative length");
+  if(readv(fd, iov, IOV_MAX + 1) >= 0)
+    fail("too many buffers");
+
+  printf("test readv/writev: OK\n");
+done:
+  close(fd);
+  unlink(FILE);
+}
+
+// readv and writev work on pipes; pread and pwrite don't.
+static void
+testpipe(void)
+{
+  struct iovec iov[2];
+  int p[2];
+
+  printf("start: pipes\n");
+  if(pipe(p) < 0)
+    fail("pipe");
+  iov[0].base = "hello ";
+  iov[0].len = 6;
+  iov[1].base = "world";
+  iov[1].len = 6;
+  if(writev(p[1], iov, 2) != 12)
+    fail("writev");
+  memset(got, 0, sizeof(got));
+  iov[0].base = got;
+  iov[1].base = got + 6;
+  if(readv(p[0], iov, 2) != 12 || strcmp(got, "hello world") != 0)
+    fail("readv");
+  if(pwrite(p[1], "x", 1, 0) >= 0 || pread(p[0], got, 1, 0) >= 0)
+    fail("pread/pwrite on a pipe");
+
+  printf("test pipes: OK\n");
+done:
+  close(p[0]);
+  close(p[1]);
+}
+
+int
+main(int argc, char *argv[])
+{
+  testpos();
+  testvec();
+  testpipe();
+  exit(failed);
+}
@@ -0,0 +1,90 @@
+//
+// exercise the per-CPU page caches in kalloc.c from several
+// processes at once and report how often each CPU's cache
+// satisfied kalloc() without going to the global pool.
+//
+
+#include "kernel/types.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+#define NCHILD 4
+#define ROUNDS 200
+#define NPAGES 64
+
+void
+sinfo(struct sysinfo *info)
+{
+  if(sysinfo(info) < 0){
+    printf("kalloctest: sysinfo failed\n");
+    exit(1);
+  }
+}
+
+// grow and shrink the heap so that every round allocates
+// and frees NPAGES pages.
+void
+churn(void)
+{
+  for(int i = 0; i < ROUNDS; i++){
+    char *p = sbrk(NPAGES * PGSIZE);
+    if(p == (char*)0xffffffffffffffffL){
+      printf("kalloctest: sbrk failed\n");
+      exit(1);
+    }
+    for(int j = 0; j < NPAGES; j++)
+      p[j * PGSIZE] = j;
+    sbrk(-NPAGES * PGSIZE);
+  }
+}
+
+void
+report(struct sysinfo *info)
+{
+  printf("cpu   hits  misses refills drains steals cached  hit%%\n");
+  for(int i = 0; i < NCPU; i++){
+    struct kmemstat *s = &info->kmem[i];
+    uint64 n = s->hits + s->misses;
+    if(n == 0)
+      continue;
+    printf("%d %l %l %l %l %l %l %l\n", i, s->hits, s->misses, s->refills,
+           s->drains, s->steals, s->cached, (s->hits * 100) / n);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct sysinfo before, after;
+
+  printf("kalloctest: start\n");
+  sinfo(&before);
+
+  for(int i = 0; i < NCHILD; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("kalloctest: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      churn();
+      exit(0);
+    }
+  }
+  for(int i = 0; i < NCHILD; i++){
+    int status;
+    wait(&status);
+    if(status != 0)
+      exit(1);
+  }
+
+  sinfo(&after);
+  report(&after);
+  if(after.freemem != before.freemem){
+    printf("kalloctest: FAIL free mem %l instead of %l\n",
+           after.freemem, before.freemem);
+    exit(1);
+  }
+  printf("kalloctest: OK\n");
+  exit(0);
+}
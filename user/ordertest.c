@@ -0,0 +1,86 @@
+//
+// ordered-data test: on a file system made with mkfs -o
+// (make FSORDERED=1), writing a new file sequentially should
+// log only metadata. the file's data, and the zeroing of its
+// newly allocated blocks, goes home with each commit instead.
+// compares the log counters of the statistics device before
+// and after the write.
+//
+
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "kernel/fs.h"
+#include "user/user.h"
+
+#define FILE "ordertest.f"
+#define NBLOCK 400
+#define CHUNK 8
+
+char buf[CHUNK*BSIZE];
+char report[8192];
+
+// the number that follows key in the statistics, or -1.
+int
+statnum(char *key)
+{
+  int n = statistics(report, sizeof(report) - 1);
+  int k = strlen(key);
+
+  if(n < 0){
+    printf("ordertest: statistics failed\n");
+    exit(1);
+  }
+  report[n] = 0;
+  for(char *p = report; *p; p++){
+    if(memcmp(p, key, k) == 0)
+      return atoi(p + k);
+  }
+  return -1;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fd, logged, inplace;
+
+  // "log: N commits M blocks logged ..."
+  // "log: ordered data, N blocks written in place"
+  if((inplace = statnum("ordered data, ")) < 0){
+    printf("ordertest: not an ordered file system, skipped\n");
+    exit(0);
+  }
+  logged = statnum(" commits ");
+
+  unlink(FILE);
+  if((fd = open(FILE, O_CREATE | O_WRONLY)) < 0){
+    printf("ordertest: create %s failed\n", FILE);
+    exit(1);
+  }
+  for(int i = 0; i < NBLOCK; i += CHUNK){
+    memset(buf, 'a' + i % 26, sizeof(buf));
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf("ordertest: write %s failed\n", FILE);
+      exit(1);
+    }
+  }
+  if(fsync(fd) < 0){
+    printf("ordertest: fsync failed\n");
+    exit(1);
+  }
+  close(fd);
+
+  logged = statnum(" commits ") - logged;
+  inplace = statnum("ordered data, ") - inplace;
+  printf("ordertest: %d blocks written, %d logged, %d written in place\n",
+         NBLOCK, logged, inplace);
+  unlink(FILE);
+
+  // the metadata is an inode, a bitmap block or two and maybe
+  // an extent block per commit; the data must not be logged.
+  if(inplace < NBLOCK || logged >= NBLOCK / 4){
+    printf("ordertest: FAILED, file data was logged\n");
+    exit(1);
+  }
+  printf("ordertest: OK\n");
+  exit(0);
+}
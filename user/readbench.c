@@ -0,0 +1,107 @@
+//
+// shared read benchmark: several workers read the same file
+// over and over, each through its own open(), and stat() it
+// by path between passes. readers hold the inode lock shared,
+// so on a multiprocessor the read rate should grow with the
+// number of workers instead of staying flat.
+// run with make CPUS=8 qemu to see 8 harts.
+//
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/fs.h"
+#include "user/user.h"
+
+#define FILE "readbench.f"
+#define NBLOCK 64
+#define PASSES 20
+
+char buf[BSIZE];
+
+void
+worker(void)
+{
+  struct stat st;
+  int fd;
+
+  if((fd = open(FILE, O_RDONLY)) < 0){
+    printf("readbench: open %s failed\n", FILE);
+    exit(1);
+  }
+  for(int i = 0; i < PASSES; i++){
+    if(stat(FILE, &st) < 0 || st.size != NBLOCK * BSIZE){
+      printf("readbench: stat %s failed\n", FILE);
+      exit(1);
+    }
+    for(int j = 0; j < NBLOCK; j++){
+      if(read(fd, buf, sizeof(buf)) != sizeof(buf)){
+        printf("readbench: read failed\n");
+        exit(1);
+      }
+    }
+    close(fd);
+    if((fd = open(FILE, O_RDONLY)) < 0){
+      printf("readbench: open %s failed\n", FILE);
+      exit(1);
+    }
+  }
+  close(fd);
+  exit(0);
+}
+
+// run nworkers workers at once; return elapsed ticks.
+int
+run(int nworkers)
+{
+  int start = uptime();
+
+  for(int i = 0; i < nworkers; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("readbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0)
+      worker();
+  }
+  for(int i = 0; i < nworkers; i++){
+    int status;
+    wait(&status);
+    if(status != 0)
+      exit(1);
+  }
+  return uptime() - start;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int max = 8, fd;
+
+  if(argc > 1)
+    max = atoi(argv[1]);
+
+  if((fd = open(FILE, O_CREATE | O_TRUNC | O_WRONLY)) < 0){
+    printf("readbench: create %s failed\n", FILE);
+    exit(1);
+  }
+  memset(buf, 'r', sizeof(buf));
+  for(int i = 0; i < NBLOCK; i++){
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf("readbench: write %s failed\n", FILE);
+      exit(1);
+    }
+  }
+  close(fd);
+
+  printf("readbench: %d passes over a %d block file per worker\n",
+         PASSES, NBLOCK);
+  for(int n = 1; n <= max; n *= 2){
+    int t = run(n);
+    printf("workers %d: %d ticks, %d blocks/100 ticks\n",
+           n, t, t > 0 ? (n * PASSES * NBLOCK * 100) / t : 0);
+  }
+  unlink(FILE);
+  exit(0);
+}
@@ -0,0 +1,81 @@
+//
+// sbrk benchmark: grow the heap, touch every new page and
+// shrink it again, over and over. every page comes from
+// kalloc_zeroed() in uvmalloc(), so the run time shows what
+// page clearing costs. the burst run allocates back to back
+// and soon empties the pre-zeroed pool; the paced run sleeps
+// between rounds so that the idle loop can refill it.
+//
+
+#include "kernel/types.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+#define NPAGES 256
+#define ROUNDS 100
+
+void
+sinfo(struct sysinfo *info)
+{
+  if(sysinfo(info) < 0){
+    printf("sbrkbench: sysinfo failed\n");
+    exit(1);
+  }
+}
+
+// zeroed-pool hits and misses summed over all CPUs.
+void
+zcount(uint64 *hits, uint64 *misses)
+{
+  struct sysinfo info;
+
+  sinfo(&info);
+  *hits = *misses = 0;
+  for(int i = 0; i < NCPU; i++){
+    *hits += info.kmem[i].zhits;
+    *misses += info.kmem[i].zmisses;
+  }
+}
+
+void
+round(void)
+{
+  char *p = sbrk(NPAGES * PGSIZE);
+  if(p == (char*)0xffffffffffffffffL){
+    printf("sbrkbench: sbrk failed\n");
+    exit(1);
+  }
+  for(int j = 0; j < NPAGES; j++)
+    p[j * PGSIZE] = j;
+  sbrk(-NPAGES * PGSIZE);
+}
+
+// run ROUNDS rounds, sleeping pause ticks before each one;
+// print the ticks spent outside sleep and the pool hit rate.
+void
+run(char *name, int pause)
+{
+  uint64 h0, m0, h1, m1;
+  int t = 0;
+
+  zcount(&h0, &m0);
+  for(int i = 0; i < ROUNDS; i++){
+    if(pause)
+      sleep(pause);
+    int start = uptime();
+    round();
+    t += uptime() - start;
+  }
+  zcount(&h1, &m1);
+  uint64 n = (h1 - h0) + (m1 - m0);
+  printf("%s: %d ticks for %d pages, pre-zeroed %l%%\n", name, t,
+         NPAGES * ROUNDS, n ? ((h1 - h0) * 100) / n : 0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  run("burst", 0);
+  run("paced", 1);
+  exit(0);
+}
@@ -0,0 +1,84 @@
+//
+// many-small-writes benchmark: several processes each append
+// small records to their own file, one write() per record, so
+// every record is its own file system transaction. run once
+// without fsync(), where group commit batches the records of
+// all the writers into few commits, and once with an fsync()
+// after every record.
+//
+
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define NCHILD 4
+#define NREC 200
+#define RECSZ 64
+
+char rec[RECSZ];
+
+void
+writer(char *name, int sync)
+{
+  int fd = open(name, O_CREATE | O_WRONLY);
+  if(fd < 0){
+    printf("smallwrites: open %s failed\n", name);
+    exit(1);
+  }
+  for(int i = 0; i < NREC; i++){
+    if(write(fd, rec, RECSZ) != RECSZ){
+      printf("smallwrites: write failed\n");
+      exit(1);
+    }
+    if(sync && fsync(fd) < 0){
+      printf("smallwrites: fsync failed\n");
+      exit(1);
+    }
+  }
+  close(fd);
+  exit(0);
+}
+
+// returns elapsed ticks.
+int
+run(int sync)
+{
+  char name[] = "swfile0";
+  int start = uptime();
+
+  for(int i = 0; i < NCHILD; i++){
+    name[6] = '0' + i;
+    int pid = fork();
+    if(pid < 0){
+      printf("smallwrites: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0)
+      writer(name, sync);
+  }
+  for(int i = 0; i < NCHILD; i++){
+    int status;
+    wait(&status);
+    if(status != 0)
+      exit(1);
+  }
+  int t = uptime() - start;
+  for(int i = 0; i < NCHILD; i++){
+    name[6] = '0' + i;
+    unlink(name);
+  }
+  return t;
+}
+
+int
+main(int argc, char *argv[])
+{
+  memset(rec, 'x', RECSZ);
+  for(int sync = 0; sync < 2; sync++){
+    int t = run(sync);
+    printf("smallwrites: %s: %d writes in %d ticks, %d writes/100 ticks\n",
+           sync ? "fsync" : "nosync", NCHILD * NREC, t,
+           t > 0 ? (NCHILD * NREC * 100) / t : 0);
+  }
+  exit(0);
+}
@@ -0,0 +1,22 @@
+//
+// print the kernel's statistics report: lock contention,
+// slab cache occupancy and buffer cache read-ahead.
+//
+
+#include "kernel/types.h"
+#include "user/user.h"
+
+#define SZ 8192
+char buf[SZ];
+
+int
+main(void)
+{
+  int n;
+
+  n = statistics(buf, SZ);
+  if(n < 0)
+    exit(1);
+  write(1, buf, n);
+  exit(0);
+}
@@ -1,6 +1,7 @@
 #include "kernel/types.h"
 struct stat;
 struct sysinfo;
+struct iovec;
 
 // system calls
 int fork(void);
@@ -34,6 +35,12 @@ int sigreturn(void);
 int connect(uint32, uint16, uint16);
 void* mmap(void* addr,int length,int prot , int flags , int fd ,uint offset);
 int munmap(void *addr,int length);
+int fsync(int);
+int fibmap(int, int);
+int pread(int, void*, int, uint);
+int pwrite(int, const void*, int, uint);
+int readv(int, const struct iovec*, int);
+int writev(int, const struct iovec*, int);
 // ulib.c
 int stat(const char*, struct stat*);
 char* strcpy(char*, const char*);
@@ -51,3 +58,6 @@ int atoi(const char*);
 uint64 atoul(const char*);
 int memcmp(const void *, const void *, uint);
 void *memcpy(void *, const void *, uint);
+
+// statistics.c
+int statistics(void*, int);
@@ -45,3 +45,9 @@ entry("connect");
 entry("symlink");
 entry("mmap");
 entry("munmap");
+entry("fsync");
+entry("fibmap");
+entry("pread");
+entry("pwrite");
+entry("readv");
+entry("writev");